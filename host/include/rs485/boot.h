@@ -0,0 +1,120 @@
+/*==================================================================================================*
+ *SYNOPSIS:
+ *	Firmware update of rs485boot Slaves (see src/rs485boot/rs485boot.h): the pages of an image
+ *	are broadcast to all Slaves at once, then each Slave is verified and gets its failed pages
+ *	again, addressed at it.
+ *
+ *	The Slaves don't receive while they write a page, so the sender waits pageWrite after each
+ *	RS485BOOT_WRITE broadcast. The bootloader starts each page all 0xFF, so only the data messages
+ *	with other bytes are sent (an erased page gets just its last one); erased pages are still
+ *	written, so the flash CRC16 of the verification covers the whole image. Page 0 is written
+ *	last, after the other pages, since the bootloader erases it with the first other page: an
+ *	update cut short leaves the Slaves in the bootloader (no reset vector) until the next one.
+ *==================================================================================================*/
+#ifndef RS485_BOOT_H
+#define RS485_BOOT_H
+
+#include <rs485/master.h>
+#include <rs485/transport.h>
+
+#include <array>
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <istream>
+#include <optional>
+#include <string>
+#include <vector>
+
+namespace rs485 {
+
+// Bootloader Commands and RS485BOOT_WRITE status, as in rs485boot.h.
+constexpr uint8_t BOOT_ENTER = 0xF0;
+constexpr uint8_t BOOT_DATA = 0xF1;
+constexpr uint8_t BOOT_WRITE = 0xF2;
+constexpr uint8_t BOOT_VERIFY = 0xF3;
+constexpr uint8_t BOOT_EXIT = 0xF4;
+constexpr std::size_t BOOT_DATA_LEN = 8;					//Data bytes per RS485BOOT_DATA message.
+
+enum class BootStatus : uint8_t {
+	Ok = 0,													//Page written and verified.
+	BadData = 1,											//Page CRC16 wrong (DATA message lost).
+	Protected = 2,											//Page is in the boot section.
+	BadFlash = 3											//Page written, but flash differs.
+};
+
+// Read an Intel HEX file (record types 00, 01, 02 and 04) into a flash image; bytes not in the
+// file are 0xFF. Throws std::runtime_error for a malformed record or a wrong checksum.
+std::vector<uint8_t> readIntelHex(std::istream& in);
+
+struct BootOptions {
+	std::chrono::microseconds responseTimeout{250000};		//VERIFY reads the whole image.
+	unsigned retries = 2;									//Retries of a Request without Response.
+	unsigned enterRepeat = 10;								//ENTER broadcasts while the Slaves reset,
+	std::chrono::microseconds enterInterval{100000};		//  this far apart.
+	std::chrono::microseconds pageWrite{12000};				//Page erase and write time of a Slave,
+	std::chrono::microseconds pageErase{5000};				//  plus page 0 erase for the first page.
+	unsigned rewrites = 3;									//Rounds of resending failed pages.
+	std::chrono::microseconds turnaround{0};				//Bus idle time before each message.
+};
+
+// Response of RS485BOOT_ENTER.
+struct BootInfo {
+	uint16_t pageSize;
+	std::array<uint8_t, 3> signature;
+	uint8_t version;
+	uint16_t pages;											//Application pages.
+};
+
+// Response of RS485BOOT_VERIFY.
+struct BootVerify {
+	uint8_t failedPages;
+	uint16_t firstFailed;									//0xFFFF if none.
+	uint16_t crc;											//CRC16 of the flash pages.
+};
+
+struct BootResult {
+	uint8_t slave;
+	bool ok;												//Image written and verified.
+	unsigned rewrites;										//Pages sent again to this Slave.
+	std::string error;										//Why not, if not ok.
+};
+
+class BootLoader {
+public:
+	// Progress of the broadcast stream: pages sent so far and all pages.
+	using ProgressCallback = std::function<void(std::size_t done, std::size_t total)>;
+
+	// The transport must outlive the BootLoader.
+	explicit BootLoader(Transport& bus, BootOptions options = {});
+
+	// Update the given Slaves with the image: ENTER, the broadcast stream, verification and
+	// resending of the failed pages per Slave, and EXIT. Slaves that don't answer or don't fit
+	// the image (page size, signature, size) are left out. If signature is given, it must match.
+	std::vector<BootResult> update(const std::vector<uint8_t>& image, const std::vector<uint8_t>& slaves,
+		const std::optional<std::array<uint8_t, 3>>& signature = std::nullopt,
+		const ProgressCallback& progress = nullptr);
+
+	// Steps of update, for tools and tests. A slave of BROADCAST sends to all Slaves.
+	void enter();
+	std::optional<BootInfo> info(uint8_t slave);
+	void sendPage(const std::vector<uint8_t>& image, uint16_t page, uint16_t pageSize, uint8_t slave = BROADCAST);
+	std::optional<BootStatus> writePage(const std::vector<uint8_t>& image, uint16_t page, uint16_t pageSize,
+		uint8_t slave);
+	std::optional<BootVerify> verify(uint8_t slave, uint16_t first, uint16_t count);
+	void exit();
+
+	// CRC16 of pages [first, first+count) of the image, as RS485BOOT_VERIFY calculates it.
+	static uint16_t imageCrc(const std::vector<uint8_t>& image, uint16_t first, uint16_t count, uint16_t pageSize);
+
+	Master& master() { return master_; }
+
+private:
+	Transport& bus_;
+	BootOptions options_;
+	Master master_;
+};
+
+} // namespace rs485
+
+#endif
@@ -0,0 +1,120 @@
+/*==================================================================================================*
+ *SYNOPSIS:
+ *	Wire format of the rs485lib protocol (see src/rs485lib/rs485lib.h): message structure, CRC16,
+ *	encoding of a message into bus bytes and a decoder that follows the RX ISR state machine.
+ *
+ *	Bus bytes, 9 data bits each (the 9th bit is set on the address byte only):
+ *
+ *	ADDR  CMD  PLEN  PARAM[0..PLEN-1]  CRC16-low  CRC16-high
+ *
+ *	ADDR bit 7 (RESPONSE_EXPECTED) asks the Slave for a Response; address 0 is the broadcast
+ *	address. With sequence numbers, bits 7-4 of PLEN carry the sequence number (1-15, 0 = none).
+ *	The CRC16 (CCITT, 0x1021, preset 0xFFFF) covers the bytes from ADDR to the last parameter
+ *	as they are sent, so including the RESP bit and the sequence number.
+ *==================================================================================================*/
+#ifndef RS485_FRAME_H
+#define RS485_FRAME_H
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <vector>
+
+namespace rs485 {
+
+constexpr std::size_t PARAM_LEN = 12;						//Maximum message parameter length.
+constexpr std::size_t FRAME_LEN = PARAM_LEN + 5;			//Maximum bus frame length (17).
+constexpr uint8_t BROADCAST = 0;							//Broadcast address.
+constexpr uint8_t RESPONSE_EXPECTED = 0x80;					//Address byte bit: Response required.
+constexpr uint8_t CMD_BATCH = 0xFF;							//Command/Result of a batch message.
+constexpr uint8_t CMD_TDMA_SYNC = 0xFE;						//Command of a TDMA sync frame.
+
+// One byte on the bus, with its 9th bit (set for the address byte).
+struct Symbol {
+	uint8_t data;
+	bool address;
+};
+
+// Request or Response message, like the RS485MSG_xxx structure.
+struct Message {
+	uint8_t addr = 0;										//Address byte, including RESPONSE_EXPECTED.
+	uint8_t cmd = 0;										//Command/Result byte.
+	uint8_t seq = 0;										//Sequence number (1-15, 0 = none).
+	std::vector<uint8_t> params;							//Parameters (0-PARAM_LEN bytes).
+
+	uint8_t slave() const { return addr & ~RESPONSE_EXPECTED; }
+	bool responseExpected() const { return (addr & RESPONSE_EXPECTED) != 0; }
+};
+
+// Bus statistics, like the RS485STAT_xxx counters.
+struct Stats {
+	unsigned long bus = 0;									//Address frames seen on the bus.
+	unsigned long addr = 0;									//Messages addressed at us (or broadcast).
+	unsigned long rx = 0;									//Messages received with valid length and CRC16.
+	unsigned long tx = 0;									//Messages sent.
+	unsigned long crc = 0;									//Messages dropped for an invalid CRC16.
+	unsigned long frame = 0;								//Frame/parity errors reported by the transport.
+	unsigned long drop = 0;									//Messages dropped (invalid length).
+	unsigned long reset = 0;								//Unsollicited address bytes (state resets).
+};
+
+// Add a byte to a running CRC16 (preset 0xFFFF); same result as rs485_crc_update.
+uint16_t crc16_update(uint16_t crc, uint8_t data);
+uint16_t crc16(const uint8_t* data, std::size_t len);
+
+// Encode a message into its bus bytes (first byte is the address byte). Throws
+// std::invalid_argument for more than PARAM_LEN parameters or a sequence number above 15.
+std::vector<uint8_t> encode(const Message& msg);
+
+// Receive state machine of the RX ISR: waits for an address byte, checks the address with the
+// filter, and collects the message body up to and including the CRC16. An address byte in the
+// middle of a message restarts the decoder with it (state machine reset).
+class FrameDecoder {
+public:
+	using Filter = std::function<bool(uint8_t addr)>;
+
+	// Without a filter all addresses are received (Master mode).
+	explicit FrameDecoder(bool sequenceNumbers = false, Filter filter = nullptr);
+
+	// Feed one bus byte; returns true when a complete, valid message is available.
+	bool feed(Symbol sym);
+	// Drop a partially received message and wait for the next address byte.
+	void reset() { state_ = State::Request; }
+	// Report a frame/parity error from the transport; the current message is dropped.
+	void error();
+
+	const Message& message() const { return msg_; }
+	const Stats& stats() const { return stats_; }
+	Stats& stats() { return stats_; }
+
+private:
+	enum class State { Request, Command, Length, Body, Ignore };
+
+	bool sequenceNumbers_;
+	Filter filter_;
+	State state_ = State::Request;
+	Message msg_;
+	std::size_t plen_ = 0;
+	std::array<uint8_t, 2> crcBytes_{};
+	std::size_t crcCount_ = 0;
+	uint16_t crc_ = 0xFFFF;
+	Stats stats_;
+
+	bool body(uint8_t data);
+};
+
+// Parameters of a batch message (CMD_BATCH): [Command][N][N parameters] tuples.
+struct BatchItem {
+	uint8_t cmd;
+	std::vector<uint8_t> params;
+};
+// Pack the tuples into the parameters of one batch message; throws std::invalid_argument if
+// they don't fit in PARAM_LEN bytes.
+std::vector<uint8_t> batch_encode(const std::vector<BatchItem>& items);
+// Split the parameters of a batch message; a truncated last tuple is dropped.
+std::vector<BatchItem> batch_decode(const std::vector<uint8_t>& params);
+
+} // namespace rs485
+
+#endif
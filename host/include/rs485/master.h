@@ -0,0 +1,110 @@
+/*==================================================================================================*
+ *SYNOPSIS:
+ *	rs485lib bus Master for a host (PC, Raspberry Pi): Requests, Broadcasts and batched polling
+ *	of Slaves, with the retry/offline rules of the RS485_poll_run scheduler.
+ *
+ *	A poll sends a Request with RESPONSE_EXPECTED and waits for the Response of that Slave. After
+ *	a response timeout the Slave is polled again right away, up to retries times (with the same
+ *	sequence number), then it is marked offline. An offline Slave is polled once, without
+ *	retries, so a batch over many Slaves isn't held up by the ones that are gone; it is online
+ *	again as soon as it responds.
+ *
+ *	All bus access is serialized: the synchronous calls and the batches of pollAsync (run in
+ *	order on the bus thread of the Master) can be used from any thread.
+ *==================================================================================================*/
+#ifndef RS485_MASTER_H
+#define RS485_MASTER_H
+
+#include <rs485/frame.h>
+#include <rs485/transport.h>
+
+#include <array>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <future>
+#include <mutex>
+#include <optional>
+#include <thread>
+#include <vector>
+
+namespace rs485 {
+
+struct MasterOptions {
+	std::chrono::microseconds responseTimeout{20000};		//After the Request is sent.
+	unsigned retries = 2;									//Retries before a Slave is marked offline.
+	bool sequenceNumbers = false;							//Slaves built with RS485_RESP_CACHE=1.
+	std::chrono::microseconds turnaround{0};				//Bus idle time before each Request.
+};
+
+struct PollRequest {
+	uint8_t slave;											//Slave address (1-127).
+	uint8_t cmd;											//Command.
+	std::vector<uint8_t> params;							//Parameters (0-PARAM_LEN bytes).
+};
+
+enum class PollStatus {
+	Ok,														//Response received.
+	Offline													//No Response; Slave is (now) offline.
+};
+
+struct PollResult {
+	uint8_t slave;
+	PollStatus status;
+	unsigned attempts;										//Requests sent for this poll.
+	Message response;										//Valid if status is Ok.
+};
+
+class Master {
+public:
+	using ResultCallback = std::function<void(const PollResult&)>;
+
+	// The transport must outlive the Master.
+	explicit Master(Transport& bus, MasterOptions options = {});
+	~Master();
+	Master(const Master&) = delete;
+	Master& operator=(const Master&) = delete;
+
+	// Send a Broadcast (no Response) or a Request without Response. Throws std::invalid_argument
+	// for an invalid address or more than PARAM_LEN parameters.
+	void broadcast(uint8_t cmd, const std::vector<uint8_t>& params = {});
+	void send(uint8_t slave, uint8_t cmd, const std::vector<uint8_t>& params = {});
+
+	// Poll one Slave (with retries); see the poll rules above.
+	PollResult poll(const PollRequest& req);
+	std::optional<Message> request(uint8_t slave, uint8_t cmd, const std::vector<uint8_t>& params = {});
+
+	// Poll the Slaves of a batch in order, back to back on the bus.
+	std::vector<PollResult> pollBatch(const std::vector<PollRequest>& batch, const ResultCallback& onResult = nullptr);
+	// Queue a batch for the bus thread and return right away; onResult (if given) is called on the
+	// bus thread for each Slave as soon as its poll is done (it must not call the Master).
+	std::future<std::vector<PollResult>> pollAsync(std::vector<PollRequest> batch, ResultCallback onResult = nullptr);
+
+	bool online(uint8_t slave) const;
+	Stats stats() const;
+
+private:
+	Transport& bus_;
+	MasterOptions options_;
+	FrameDecoder decoder_;
+	std::array<uint8_t, 128> seq_{};						//Last sequence number per Slave.
+	std::array<bool, 128> offline_{};
+	mutable std::mutex busLock_;							//Serializes bus access and the state above.
+
+	std::mutex jobLock_;
+	std::condition_variable jobReady_;
+	std::deque<std::packaged_task<std::vector<PollResult>()>> jobs_;
+	std::thread worker_;
+	bool stop_ = false;
+
+	void transmit(const Message& msg);
+	bool awaitResponse(uint8_t slave, uint8_t seq, Message& response);
+	PollResult pollLocked(const PollRequest& req);
+	void run();
+};
+
+} // namespace rs485
+
+#endif
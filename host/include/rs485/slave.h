@@ -0,0 +1,64 @@
+/*==================================================================================================*
+ *SYNOPSIS:
+ *	rs485lib bus Slave for a host, like RS485_dispatch: a handler per Command, a Response when the
+ *	Master expects one, multicast groups and (with sequence numbers) the response cache that
+ *	answers a retry without calling the handler again.
+ *==================================================================================================*/
+#ifndef RS485_SLAVE_H
+#define RS485_SLAVE_H
+
+#include <rs485/frame.h>
+#include <rs485/transport.h>
+
+#include <array>
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <optional>
+#include <vector>
+
+namespace rs485 {
+
+struct SlaveOptions {
+	bool sequenceNumbers = false;							//Like RS485_RESP_CACHE=1.
+	std::vector<uint8_t> groups;							//Multicast group addresses joined.
+	std::chrono::microseconds turnaround{0};				//Bus idle time before a Response.
+};
+
+class Slave {
+public:
+	// Called with the Request and a Response preset with our address, the Command as Result, no
+	// parameters and the sequence number of the Request.
+	using Handler = std::function<void(const Message& request, Message& response)>;
+
+	// The transport must outlive the Slave. Throws std::invalid_argument for an address outside
+	// 1..127 or an invalid group address.
+	Slave(Transport& bus, uint8_t address, SlaveOptions options = {});
+
+	void on(uint8_t cmd, Handler handler);
+	// Handler for all Commands without their own; without it those Requests are ignored.
+	void onUnknown(Handler handler);
+
+	// Receive and handle one Request; returns false if none arrived within timeout.
+	bool serve(std::chrono::microseconds timeout);
+
+	uint8_t address() const { return address_; }
+	const Stats& stats() const { return decoder_.stats(); }
+
+private:
+	Transport& bus_;
+	uint8_t address_;
+	SlaveOptions options_;
+	FrameDecoder decoder_;
+	std::array<Handler, 256> handlers_;
+	Handler unknown_;
+	std::optional<Message> cache_;							//Last Response sent for a sequence number.
+	uint8_t cacheCmd_ = 0;
+
+	bool accepts(uint8_t addr) const;
+	void respond(const Message& response);
+};
+
+} // namespace rs485
+
+#endif
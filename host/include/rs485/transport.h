@@ -0,0 +1,100 @@
+/*==================================================================================================*
+ *SYNOPSIS:
+ *	Byte transports for the rs485lib protocol: a POSIX serial device with 9-bit frames, and a pty
+ *	(or any other stream) that carries the 9th bit in-band, as a stand-in for the bus in tests.
+ *
+ *	9-bit frames on a serial device use the parity bit as 9th bit (CMSPAR, "stick" parity): mark
+ *	parity for the address byte, space parity for the other bytes. The receiver runs with space
+ *	parity and PARMRK, so the kernel marks each address byte with 0xFF 0x00 before it and
+ *	doubles a data byte 0xFF. The stream transport uses the same encoding on both sides, so both
+ *	share one decoder. The serial device needs an RS485 adapter that switches direction by
+ *	itself (or the kernel's RS485 mode); a Master with local echo can drop its own bytes.
+ *==================================================================================================*/
+#ifndef RS485_TRANSPORT_H
+#define RS485_TRANSPORT_H
+
+#include <rs485/frame.h>
+
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace rs485 {
+
+// Result of Transport::receive.
+enum class RxStatus {
+	Ok,														//Symbol received.
+	Timeout,												//Nothing received in time.
+	Error													//Frame/parity error (byte dropped).
+};
+
+class Transport {
+public:
+	virtual ~Transport() = default;
+
+	// Send the bus bytes of one message; the first byte is sent as address byte (9th bit set).
+	virtual void send(const std::vector<uint8_t>& frame) = 0;
+	// Receive the next bus byte, waiting at most timeout.
+	virtual RxStatus receive(Symbol& sym, std::chrono::microseconds timeout) = 0;
+	// Drop all bytes received so far.
+	virtual void flush() = 0;
+	// Time on the bus of one byte (start, 8 data, 9th and stop bit).
+	virtual std::chrono::microseconds byteTime() const = 0;
+};
+
+// Transport on a file descriptor carrying the 9th bit in-band (0xFF 0x00 before an address
+// byte, 0xFF 0xFF for a data byte 0xFF). Throws std::system_error on I/O errors.
+class StreamTransport : public Transport {
+public:
+	// Takes ownership of fd. baud only sets the byte time used for timeouts.
+	explicit StreamTransport(int fd, unsigned baud = 38400);
+	~StreamTransport() override;
+	StreamTransport(const StreamTransport&) = delete;
+	StreamTransport& operator=(const StreamTransport&) = delete;
+
+	// Open both ends of a new pty pair, in raw mode, as the two sides of a bus link.
+	static void openPair(std::unique_ptr<StreamTransport>& a, std::unique_ptr<StreamTransport>& b,
+		unsigned baud = 38400);
+
+	void send(const std::vector<uint8_t>& frame) override;
+	RxStatus receive(Symbol& sym, std::chrono::microseconds timeout) override;
+	void flush() override;
+	std::chrono::microseconds byteTime() const override;
+
+protected:
+	int fd_;
+	unsigned baud_;
+
+	void writeAll(const uint8_t* data, std::size_t len);
+
+private:
+	std::vector<uint8_t> buf_;
+	std::size_t pos_ = 0;
+
+	bool fill(std::chrono::steady_clock::time_point deadline);
+	bool next(uint8_t& byte, std::chrono::steady_clock::time_point deadline);
+};
+
+// POSIX serial device with 9-bit frames through stick parity (Linux: CMSPAR).
+class SerialTransport : public StreamTransport {
+public:
+	// Open device (e.g. /dev/ttyUSB0) at baud, 8 data bits, stick parity, 1 stop bit. With echo,
+	// the bytes sent are read back and dropped (adapters that hear their own transmission).
+	// Throws std::system_error if the device can't be opened or set up, std::invalid_argument for
+	// a baud rate the termios interface doesn't know.
+	SerialTransport(const std::string& device, unsigned baud, bool echo = false);
+
+	void send(const std::vector<uint8_t>& frame) override;
+
+private:
+	bool echo_;
+
+	void setParity(bool mark);
+};
+
+} // namespace rs485
+
+#endif
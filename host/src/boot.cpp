@@ -0,0 +1,278 @@
+/*==================================================================================================*
+ *SYNOPSIS:
+ *	Firmware update of rs485boot Slaves: Intel HEX reader, broadcast page stream and per Slave
+ *	verification.
+ *==================================================================================================*/
+#include <rs485/boot.h>
+
+#include <algorithm>
+#include <stdexcept>
+#include <thread>
+
+namespace rs485 {
+
+static int hexDigit(char c)
+{
+	if (c >= '0' && c <= '9')
+		return c - '0';
+	if (c >= 'A' && c <= 'F')
+		return c - 'A' + 10;
+	if (c >= 'a' && c <= 'f')
+		return c - 'a' + 10;
+	return -1;
+}
+
+std::vector<uint8_t> readIntelHex(std::istream& in)
+{
+	std::vector<uint8_t> image;
+	uint32_t base = 0;
+	std::string line;
+	for (unsigned number = 1; std::getline(in, line); ++number) {
+		while (!line.empty() && (line.back() == '\r' || line.back() == ' '))
+			line.pop_back();
+		if (line.empty())
+			continue;
+		auto bad = [number](const char* what) {
+			return std::runtime_error("rs485: Intel HEX line " + std::to_string(number) + ": " + what);
+		};
+		if (line[0] != ':' || line.size() < 11 || line.size() % 2 == 0)
+			throw bad("not a record");
+		std::vector<uint8_t> rec;
+		uint8_t sum = 0;
+		for (std::size_t i = 1; i < line.size(); i += 2) {
+			int hi = hexDigit(line[i]), lo = hexDigit(line[i + 1]);
+			if (hi < 0 || lo < 0)
+				throw bad("not a hex digit");
+			rec.push_back(static_cast<uint8_t>(hi << 4 | lo));
+			sum = static_cast<uint8_t>(sum + rec.back());
+		}
+		if (rec.size() != rec[0] + 5u)
+			throw bad("wrong record length");
+		if (sum != 0)
+			throw bad("wrong checksum");
+		uint32_t addr = base + (rec[1] << 8 | rec[2]);
+		const uint8_t* data = &rec[4];
+		switch (rec[3]) {
+		case 0x00:												//Data.
+			if (image.size() < addr + rec[0])
+				image.resize(addr + rec[0], 0xFF);
+			std::copy(data, data + rec[0], image.begin() + addr);
+			break;
+		case 0x01:												//End of file.
+			return image;
+		case 0x02:												//Extended segment address.
+			if (rec[0] != 2)
+				throw bad("wrong record length");
+			base = static_cast<uint32_t>(data[0] << 8 | data[1]) << 4;
+			break;
+		case 0x04:												//Extended linear address.
+			if (rec[0] != 2)
+				throw bad("wrong record length");
+			base = static_cast<uint32_t>(data[0] << 8 | data[1]) << 16;
+			break;
+		default:												//Start addresses: not used.
+			break;
+		}
+	}
+	return image;
+}
+
+static uint8_t imageByte(const std::vector<uint8_t>& image, std::size_t addr)
+{
+	return addr < image.size() ? image[addr] : 0xFF;
+}
+
+BootLoader::BootLoader(Transport& bus, BootOptions options)
+	: bus_(bus), options_(options),
+	  master_(bus, MasterOptions{options.responseTimeout, options.retries, false, options.turnaround})
+{
+}
+
+void BootLoader::enter()
+{
+	for (unsigned i = 0; i < options_.enterRepeat; ++i) {
+		if (i)
+			std::this_thread::sleep_for(options_.enterInterval);
+		master_.broadcast(BOOT_ENTER);
+	}
+}
+
+std::optional<BootInfo> BootLoader::info(uint8_t slave)
+{
+	auto resp = master_.request(slave, BOOT_ENTER);
+	if (!resp || resp->params.size() < 8)
+		return std::nullopt;
+	const std::vector<uint8_t>& p = resp->params;
+	return BootInfo{static_cast<uint16_t>(p[0] | p[1] << 8), {p[2], p[3], p[4]}, p[5],
+		static_cast<uint16_t>(p[6] | p[7] << 8)};
+}
+
+void BootLoader::sendPage(const std::vector<uint8_t>& image, uint16_t page, uint16_t pageSize, uint8_t slave)
+{
+	std::size_t start = static_cast<std::size_t>(page) * pageSize;
+	bool sent = false;
+	for (std::size_t offset = 0; offset < pageSize; offset += BOOT_DATA_LEN) {
+		std::vector<uint8_t> params{static_cast<uint8_t>(page), static_cast<uint8_t>(page >> 8),
+			static_cast<uint8_t>(offset)};
+		bool erased = true;										//The page starts all 0xFF.
+		for (std::size_t i = 0; i < BOOT_DATA_LEN; ++i) {
+			params.push_back(imageByte(image, start + offset + i));
+			erased = erased && params.back() == 0xFF;
+		}
+		if (erased && (sent || offset + BOOT_DATA_LEN < pageSize))
+			continue;											//At least one, to start the page.
+		sent = true;
+		if (slave == BROADCAST)
+			master_.broadcast(BOOT_DATA, params);
+		else
+			master_.send(slave, BOOT_DATA, params);
+	}
+}
+
+std::optional<BootStatus> BootLoader::writePage(const std::vector<uint8_t>& image, uint16_t page,
+	uint16_t pageSize, uint8_t slave)
+{
+	uint16_t crc = imageCrc(image, page, 1, pageSize);
+	std::vector<uint8_t> params{static_cast<uint8_t>(page), static_cast<uint8_t>(page >> 8),
+		static_cast<uint8_t>(crc), static_cast<uint8_t>(crc >> 8)};
+	if (slave == BROADCAST) {
+		master_.broadcast(BOOT_WRITE, params);
+		// The Slaves don't receive while writing: wait until the message is out and written.
+		std::this_thread::sleep_for(options_.pageWrite + bus_.byteTime() * FRAME_LEN);
+		return std::nullopt;
+	}
+	auto resp = master_.request(slave, BOOT_WRITE, params);
+	if (!resp || resp->params.empty())
+		return std::nullopt;
+	return static_cast<BootStatus>(resp->params[0]);
+}
+
+std::optional<BootVerify> BootLoader::verify(uint8_t slave, uint16_t first, uint16_t count)
+{
+	auto resp = master_.request(slave, BOOT_VERIFY, {static_cast<uint8_t>(first), static_cast<uint8_t>(first >> 8),
+		static_cast<uint8_t>(count), static_cast<uint8_t>(count >> 8)});
+	if (!resp || resp->params.size() < 5)
+		return std::nullopt;
+	const std::vector<uint8_t>& p = resp->params;
+	return BootVerify{p[0], static_cast<uint16_t>(p[1] | p[2] << 8), static_cast<uint16_t>(p[3] | p[4] << 8)};
+}
+
+void BootLoader::exit()
+{
+	master_.broadcast(BOOT_EXIT);
+}
+
+uint16_t BootLoader::imageCrc(const std::vector<uint8_t>& image, uint16_t first, uint16_t count, uint16_t pageSize)
+{
+	uint16_t crc = 0xFFFF;
+	std::size_t end = (static_cast<std::size_t>(first) + count) * pageSize;
+	for (std::size_t addr = static_cast<std::size_t>(first) * pageSize; addr < end; ++addr)
+		crc = crc16_update(crc, imageByte(image, addr));
+	return crc;
+}
+
+std::vector<BootResult> BootLoader::update(const std::vector<uint8_t>& image, const std::vector<uint8_t>& slaves,
+	const std::optional<std::array<uint8_t, 3>>& signature, const ProgressCallback& progress)
+{
+	std::vector<BootResult> results;
+	for (uint8_t slave : slaves)
+		results.push_back({slave, false, 0, {}});
+
+	// Enter the bootloader on all Slaves, and check each one against the image.
+	enter();
+	std::optional<BootInfo> ref;
+	std::size_t used = image.size();
+	while (used && image[used - 1] == 0xFF)
+		--used;
+	uint16_t pages = 0;
+	std::vector<BootResult*> active;
+	for (BootResult& result : results) {
+		std::optional<BootInfo> bi = info(result.slave);
+		if (!bi) {
+			result.error = "no response";
+			continue;
+		}
+		if (!ref) {
+			ref = bi;
+			if (signature && bi->signature != *signature) {
+				ref.reset();
+				result.error = "wrong signature";
+				continue;
+			}
+			pages = static_cast<uint16_t>((used + bi->pageSize - 1) / bi->pageSize);
+		}
+		if (bi->pageSize != ref->pageSize || bi->signature != ref->signature)
+			result.error = "other device type";
+		else if (pages > bi->pages)
+			result.error = "image does not fit";
+		else
+			active.push_back(&result);
+	}
+	if (active.empty())
+		return results;
+
+	// Stream the pages to all Slaves at once, page 0 (the reset vector) last: the first other page
+	// erases it, so an update cut short leaves the Slaves in the bootloader.
+	for (uint16_t n = 1; n <= pages; ++n) {
+		uint16_t page = n < pages ? n : 0;
+		sendPage(image, page, ref->pageSize);
+		writePage(image, page, ref->pageSize, BROADCAST);
+		if (n == 1 && page != 0)
+			std::this_thread::sleep_for(options_.pageErase);
+		if (progress)
+			progress(n, pages);
+	}
+
+	// Verify each Slave; send it the failed pages again until its flash matches the image.
+	uint16_t crc = imageCrc(image, 0, pages, ref->pageSize);
+	for (BootResult* result : active) {
+		uint8_t slave = result->slave;
+		for (unsigned round = 0;; ++round) {
+			std::optional<BootVerify> v = verify(slave, 0, pages);
+			if (!v) {
+				result->error = "no response to verify";
+				break;
+			}
+			if (v->failedPages == 0 && v->crc == crc) {
+				result->ok = true;
+				break;
+			}
+			if (round == options_.rewrites) {
+				result->error = "verify failed";
+				break;
+			}
+			info(slave);										//Clear the failed pages.
+			// One failed page is known; else check each page from the first failed one. Page 0 goes
+			// last again, also when another page is written (which erases it).
+			uint16_t from = v->failedPages ? v->firstFailed : 0;
+			uint16_t to = v->failedPages == 1 ? static_cast<uint16_t>(from + 1) : pages;
+			bool page0 = false;
+			for (uint16_t page = from; page < to && page < pages; ++page) {
+				if (to - from > 1) {
+					std::optional<BootVerify> pv = verify(slave, page, 1);
+					if (pv && pv->crc == imageCrc(image, page, 1, ref->pageSize))
+						continue;
+				}
+				page0 = true;
+				if (page == 0)
+					continue;
+				sendPage(image, page, ref->pageSize, slave);
+				writePage(image, page, ref->pageSize, slave);
+				++result->rewrites;
+			}
+			if (page0) {
+				sendPage(image, 0, ref->pageSize, slave);
+				writePage(image, 0, ref->pageSize, slave);
+				++result->rewrites;
+			}
+		}
+	}
+
+	// Start the application on the updated Slaves; the others stay in the bootloader.
+	for (BootResult* result : active)
+		if (result->ok)
+			master_.request(result->slave, BOOT_EXIT);
+	return results;
+}
+
+} // namespace rs485
@@ -0,0 +1,156 @@
+/*==================================================================================================*
+ *SYNOPSIS:
+ *	rs485lib wire format: CRC16, message encoding and the receive state machine.
+ *==================================================================================================*/
+#include <rs485/frame.h>
+
+#include <stdexcept>
+#include <utility>
+
+namespace rs485 {
+
+// CRC-16-CCITT (x16 + x12 + x5 + 1), MSB first, the same steps as rs485_crc_update.
+uint16_t crc16_update(uint16_t crc, uint8_t data)
+{
+	crc = static_cast<uint16_t>((crc >> 8) | (crc << 8));
+	crc ^= data;
+	crc ^= (crc & 0xFF) >> 4;
+	crc ^= static_cast<uint16_t>(crc << 12);
+	crc ^= static_cast<uint16_t>((crc & 0xFF) << 5);
+	return crc;
+}
+
+uint16_t crc16(const uint8_t* data, std::size_t len)
+{
+	uint16_t crc = 0xFFFF;
+	while (len--)
+		crc = crc16_update(crc, *data++);
+	return crc;
+}
+
+std::vector<uint8_t> encode(const Message& msg)
+{
+	if (msg.params.size() > PARAM_LEN)
+		throw std::invalid_argument("rs485: more than 12 parameters");
+	if (msg.seq > 15)
+		throw std::invalid_argument("rs485: sequence number above 15");
+	std::vector<uint8_t> bytes;
+	bytes.reserve(msg.params.size() + 5);
+	bytes.push_back(msg.addr);
+	bytes.push_back(msg.cmd);
+	bytes.push_back(static_cast<uint8_t>((msg.seq << 4) | msg.params.size()));
+	bytes.insert(bytes.end(), msg.params.begin(), msg.params.end());
+	uint16_t crc = crc16(bytes.data(), bytes.size());
+	bytes.push_back(static_cast<uint8_t>(crc));				//CRC16 low byte first.
+	bytes.push_back(static_cast<uint8_t>(crc >> 8));
+	return bytes;
+}
+
+FrameDecoder::FrameDecoder(bool sequenceNumbers, Filter filter)
+	: sequenceNumbers_(sequenceNumbers), filter_(std::move(filter))
+{
+}
+
+void FrameDecoder::error()
+{
+	++stats_.frame;
+	state_ = State::Request;
+}
+
+bool FrameDecoder::feed(Symbol sym)
+{
+	if (sym.address) {
+		// An unexpected address byte resets the state machine, like the RX ISR does.
+		if (state_ != State::Request && state_ != State::Ignore)
+			++stats_.reset;
+		++stats_.bus;
+		uint8_t addr = sym.data & ~RESPONSE_EXPECTED;
+		if (addr != BROADCAST && filter_ && !filter_(addr)) {
+			state_ = State::Ignore;							//Not for us (multi-processor mode).
+			return false;
+		}
+		++stats_.addr;
+		msg_.addr = sym.data;
+		msg_.seq = 0;
+		msg_.params.clear();
+		crc_ = crc16_update(0xFFFF, sym.data);
+		state_ = State::Command;
+		return false;
+	}
+	switch (state_) {
+	case State::Request:
+	case State::Ignore:
+		return false;										//Data byte of a message not for us.
+	case State::Command:
+		msg_.cmd = sym.data;
+		crc_ = crc16_update(crc_, sym.data);
+		state_ = State::Length;
+		return false;
+	case State::Length:
+		plen_ = sequenceNumbers_ ? (sym.data & 0x0F) : sym.data;
+		if (plen_ > PARAM_LEN) {
+			++stats_.drop;									//Invalid length: drop the message.
+			state_ = State::Request;
+			return false;
+		}
+		msg_.seq = sequenceNumbers_ ? static_cast<uint8_t>(sym.data >> 4) : 0;
+		crc_ = crc16_update(crc_, sym.data);
+		crcCount_ = 0;
+		state_ = State::Body;
+		return false;
+	case State::Body:
+		return body(sym.data);
+	}
+	return false;
+}
+
+bool FrameDecoder::body(uint8_t data)
+{
+	if (msg_.params.size() < plen_) {
+		msg_.params.push_back(data);
+		crc_ = crc16_update(crc_, data);
+		return false;
+	}
+	crcBytes_[crcCount_++] = data;
+	if (crcCount_ < 2)
+		return false;
+	state_ = State::Request;
+	if (static_cast<uint16_t>(crcBytes_[0] | (crcBytes_[1] << 8)) != crc_) {
+		++stats_.crc;
+		return false;
+	}
+	++stats_.rx;
+	return true;
+}
+
+std::vector<uint8_t> batch_encode(const std::vector<BatchItem>& items)
+{
+	std::vector<uint8_t> params;
+	for (const BatchItem& item : items) {
+		if (item.params.size() > 255)
+			throw std::invalid_argument("rs485: batch tuple too long");
+		params.push_back(item.cmd);
+		params.push_back(static_cast<uint8_t>(item.params.size()));
+		params.insert(params.end(), item.params.begin(), item.params.end());
+	}
+	if (params.size() > PARAM_LEN)
+		throw std::invalid_argument("rs485: batch does not fit in 12 parameters");
+	return params;
+}
+
+std::vector<BatchItem> batch_decode(const std::vector<uint8_t>& params)
+{
+	std::vector<BatchItem> items;
+	std::size_t i = 0;
+	while (i + 2 <= params.size()) {
+		std::size_t n = params[i + 1];
+		if (i + 2 + n > params.size())
+			break;
+		auto first = params.begin() + static_cast<std::ptrdiff_t>(i + 2);
+		items.push_back({params[i], std::vector<uint8_t>(first, first + static_cast<std::ptrdiff_t>(n))});
+		i += 2 + n;
+	}
+	return items;
+}
+
+} // namespace rs485
@@ -0,0 +1,188 @@
+/*==================================================================================================*
+ *SYNOPSIS:
+ *	rs485lib bus Master: Requests, Broadcasts and (batched, asynchronous) polling of Slaves.
+ *==================================================================================================*/
+#include <rs485/master.h>
+
+#include <stdexcept>
+#include <utility>
+
+namespace rs485 {
+
+Master::Master(Transport& bus, MasterOptions options)
+	: bus_(bus), options_(options), decoder_(options.sequenceNumbers)
+{
+}
+
+Master::~Master()
+{
+	{
+		std::lock_guard<std::mutex> lock(jobLock_);
+		stop_ = true;
+	}
+	jobReady_.notify_all();
+	if (worker_.joinable())
+		worker_.join();										//Queued batches are finished first.
+}
+
+void Master::broadcast(uint8_t cmd, const std::vector<uint8_t>& params)
+{
+	Message msg;
+	msg.addr = BROADCAST;
+	msg.cmd = cmd;
+	msg.params = params;
+	std::lock_guard<std::mutex> lock(busLock_);
+	transmit(msg);
+}
+
+void Master::send(uint8_t slave, uint8_t cmd, const std::vector<uint8_t>& params)
+{
+	if (slave == BROADCAST || slave & RESPONSE_EXPECTED)
+		throw std::invalid_argument("rs485: Slave address must be 1..127");
+	Message msg;
+	msg.addr = slave;
+	msg.cmd = cmd;
+	msg.params = params;
+	std::lock_guard<std::mutex> lock(busLock_);
+	transmit(msg);
+}
+
+PollResult Master::poll(const PollRequest& req)
+{
+	std::lock_guard<std::mutex> lock(busLock_);
+	return pollLocked(req);
+}
+
+std::optional<Message> Master::request(uint8_t slave, uint8_t cmd, const std::vector<uint8_t>& params)
+{
+	PollResult result = poll({slave, cmd, params});
+	if (result.status != PollStatus::Ok)
+		return std::nullopt;
+	return std::move(result.response);
+}
+
+std::vector<PollResult> Master::pollBatch(const std::vector<PollRequest>& batch, const ResultCallback& onResult)
+{
+	std::vector<PollResult> results;
+	results.reserve(batch.size());
+	std::lock_guard<std::mutex> lock(busLock_);				//The whole batch back to back.
+	for (const PollRequest& req : batch) {
+		results.push_back(pollLocked(req));
+		if (onResult)
+			onResult(results.back());
+	}
+	return results;
+}
+
+std::future<std::vector<PollResult>> Master::pollAsync(std::vector<PollRequest> batch, ResultCallback onResult)
+{
+	std::packaged_task<std::vector<PollResult>()> job(
+		[this, batch = std::move(batch), onResult = std::move(onResult)] { return pollBatch(batch, onResult); });
+	auto result = job.get_future();
+	{
+		std::lock_guard<std::mutex> lock(jobLock_);
+		jobs_.push_back(std::move(job));
+		if (!worker_.joinable())
+			worker_ = std::thread(&Master::run, this);		//Bus thread, started on first use.
+	}
+	jobReady_.notify_one();
+	return result;
+}
+
+bool Master::online(uint8_t slave) const
+{
+	std::lock_guard<std::mutex> lock(busLock_);
+	return !offline_[slave & ~RESPONSE_EXPECTED];
+}
+
+Stats Master::stats() const
+{
+	std::lock_guard<std::mutex> lock(busLock_);
+	return decoder_.stats();
+}
+
+void Master::transmit(const Message& msg)
+{
+	std::vector<uint8_t> frame = encode(msg);
+	if (options_.turnaround.count() > 0)
+		std::this_thread::sleep_for(options_.turnaround);
+	bus_.send(frame);
+	++decoder_.stats().tx;
+}
+
+// Wait for a complete Response of the Slave; other messages are dropped, and with sequence numbers
+// (seq not 0) also a late Response of an earlier poll. The timeout includes the time to send the
+// Request.
+bool Master::awaitResponse(uint8_t slave, uint8_t seq, Message& response)
+{
+	auto deadline = std::chrono::steady_clock::now() + options_.responseTimeout + bus_.byteTime() * FRAME_LEN;
+	for (;;) {
+		auto left = std::chrono::duration_cast<std::chrono::microseconds>(deadline - std::chrono::steady_clock::now());
+		if (left.count() <= 0)
+			break;
+		Symbol sym;
+		switch (bus_.receive(sym, left)) {
+		case RxStatus::Timeout:
+			break;
+		case RxStatus::Error:
+			decoder_.error();
+			continue;
+		case RxStatus::Ok:
+			if (decoder_.feed(sym) && decoder_.message().slave() == slave
+				&& (seq == 0 || decoder_.message().seq == seq)) {
+				response = decoder_.message();
+				return true;
+			}
+			continue;
+		}
+		break;
+	}
+	decoder_.reset();										//Drop a partially received message.
+	return false;
+}
+
+PollResult Master::pollLocked(const PollRequest& req)
+{
+	if (req.slave == BROADCAST || req.slave & RESPONSE_EXPECTED)
+		throw std::invalid_argument("rs485: Slave address must be 1..127");
+	Message msg;
+	msg.addr = req.slave | RESPONSE_EXPECTED;
+	msg.cmd = req.cmd;
+	msg.params = req.params;
+	if (options_.sequenceNumbers) {
+		uint8_t& seq = seq_[req.slave];
+		seq = static_cast<uint8_t>(seq % 15 + 1);			//Next number for a new poll, never 0.
+		msg.seq = seq;
+	}
+	PollResult result{req.slave, PollStatus::Offline, 0, {}};
+	unsigned tries = offline_[req.slave] ? 1 : options_.retries + 1;
+	while (result.attempts < tries) {
+		++result.attempts;
+		transmit(msg);										//A retry keeps the sequence number.
+		if (awaitResponse(req.slave, msg.seq, result.response)) {
+			result.status = PollStatus::Ok;
+			offline_[req.slave] = false;
+			return result;
+		}
+	}
+	offline_[req.slave] = true;
+	return result;
+}
+
+void Master::run()
+{
+	for (;;) {
+		std::packaged_task<std::vector<PollResult>()> job;
+		{
+			std::unique_lock<std::mutex> lock(jobLock_);
+			jobReady_.wait(lock, [this] { return stop_ || !jobs_.empty(); });
+			if (jobs_.empty())
+				return;
+			job = std::move(jobs_.front());
+			jobs_.pop_front();
+		}
+		job();
+	}
+}
+
+} // namespace rs485
@@ -0,0 +1,95 @@
+/*==================================================================================================*
+ *SYNOPSIS:
+ *	rs485lib bus Slave: Command dispatch with automatic Response and response cache.
+ *==================================================================================================*/
+#include <rs485/slave.h>
+
+#include <algorithm>
+#include <stdexcept>
+#include <thread>
+#include <utility>
+
+namespace rs485 {
+
+Slave::Slave(Transport& bus, uint8_t address, SlaveOptions options)
+	: bus_(bus), address_(address), options_(std::move(options)),
+	  decoder_(options_.sequenceNumbers, [this](uint8_t addr) { return accepts(addr); })
+{
+	if (address == BROADCAST || address & RESPONSE_EXPECTED)
+		throw std::invalid_argument("rs485: Slave address must be 1..127");
+	for (uint8_t group : options_.groups)
+		if (group == BROADCAST || group & RESPONSE_EXPECTED)
+			throw std::invalid_argument("rs485: group address must be 1..127");
+}
+
+void Slave::on(uint8_t cmd, Handler handler)
+{
+	handlers_[cmd] = std::move(handler);
+}
+
+void Slave::onUnknown(Handler handler)
+{
+	unknown_ = std::move(handler);
+}
+
+bool Slave::accepts(uint8_t addr) const
+{
+	return addr == address_ || std::find(options_.groups.begin(), options_.groups.end(), addr) != options_.groups.end();
+}
+
+bool Slave::serve(std::chrono::microseconds timeout)
+{
+	auto deadline = std::chrono::steady_clock::now() + timeout;
+	for (;;) {
+		auto left = std::chrono::duration_cast<std::chrono::microseconds>(deadline - std::chrono::steady_clock::now());
+		if (left.count() <= 0)
+			return false;
+		Symbol sym;
+		RxStatus status = bus_.receive(sym, left);
+		if (status == RxStatus::Timeout)
+			return false;
+		if (status == RxStatus::Error) {
+			decoder_.error();
+			continue;
+		}
+		if (!decoder_.feed(sym))
+			continue;
+		const Message& req = decoder_.message();
+		if (req.slave() == BROADCAST && req.cmd == CMD_TDMA_SYNC)
+			continue;										//TDMA sync: not for the application.
+		// Only a Request addressed at us gets a Response, not a Broadcast or group message.
+		bool reply = req.responseExpected() && req.slave() == address_;
+		// A retry of the last Request is answered from the cache, without calling the handler.
+		if (req.seq != 0 && cache_ && cache_->seq == req.seq && cacheCmd_ == req.cmd) {
+			if (reply)
+				respond(*cache_);
+			return true;
+		}
+		const Handler& handler = handlers_[req.cmd] ? handlers_[req.cmd] : unknown_;
+		if (!handler)
+			return true;									//Unknown Command, no handler: ignored.
+		Message resp;
+		resp.addr = address_;
+		resp.cmd = req.cmd;
+		resp.seq = req.seq;									//Echo the sequence number.
+		handler(req, resp);
+		if (req.seq != 0) {
+			cache_ = resp;
+			cacheCmd_ = req.cmd;
+		}
+		if (reply)
+			respond(resp);
+		return true;
+	}
+}
+
+void Slave::respond(const Message& response)
+{
+	std::vector<uint8_t> frame = encode(response);
+	if (options_.turnaround.count() > 0)
+		std::this_thread::sleep_for(options_.turnaround);
+	bus_.send(frame);
+	++decoder_.stats().tx;
+}
+
+} // namespace rs485
@@ -0,0 +1,286 @@
+/*==================================================================================================*
+ *SYNOPSIS:
+ *	rs485lib byte transports: in-band 9th bit on a stream (pty), stick parity on a serial device.
+ *==================================================================================================*/
+#include <rs485/transport.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdlib>
+#include <stdexcept>
+#include <system_error>
+
+#include <fcntl.h>
+#include <poll.h>
+#include <termios.h>
+#include <unistd.h>
+
+namespace rs485 {
+
+namespace {
+
+constexpr uint8_t MARK = 0xFF;								//PARMRK escape byte.
+
+[[noreturn]] void throw_errno(const char* what)
+{
+	throw std::system_error(errno, std::generic_category(), what);
+}
+
+int poll_timeout(std::chrono::steady_clock::time_point deadline)
+{
+	auto left = std::chrono::duration_cast<std::chrono::milliseconds>(
+		deadline - std::chrono::steady_clock::now() + std::chrono::microseconds(999));
+	return left.count() > 0 ? static_cast<int>(left.count()) : 0;
+}
+
+void make_raw(int fd)
+{
+	termios t;
+	if (tcgetattr(fd, &t) < 0)
+		throw_errno("rs485: tcgetattr");
+	cfmakeraw(&t);
+	t.c_cc[VMIN] = 0;
+	t.c_cc[VTIME] = 0;
+	if (tcsetattr(fd, TCSANOW, &t) < 0)
+		throw_errno("rs485: tcsetattr");
+}
+
+speed_t baud_to_speed(unsigned baud)
+{
+	switch (baud) {
+	case 1200: return B1200;
+	case 2400: return B2400;
+	case 4800: return B4800;
+	case 9600: return B9600;
+	case 19200: return B19200;
+	case 38400: return B38400;
+	case 57600: return B57600;
+	case 115200: return B115200;
+	case 230400: return B230400;
+#ifdef B250000
+	case 250000: return B250000;
+#endif
+#ifdef B500000
+	case 500000: return B500000;
+#endif
+#ifdef B1000000
+	case 1000000: return B1000000;
+#endif
+	default: throw std::invalid_argument("rs485: unsupported baud rate");
+	}
+}
+
+} // namespace
+
+/*--------------------------------------------------------------------------------------------------*
+ * StreamTransport
+ *--------------------------------------------------------------------------------------------------*/
+StreamTransport::StreamTransport(int fd, unsigned baud)
+	: fd_(fd), baud_(baud)
+{
+	buf_.reserve(256);
+}
+
+StreamTransport::~StreamTransport()
+{
+	if (fd_ >= 0)
+		::close(fd_);
+}
+
+void StreamTransport::openPair(std::unique_ptr<StreamTransport>& a, std::unique_ptr<StreamTransport>& b,
+	unsigned baud)
+{
+	int master = ::posix_openpt(O_RDWR | O_NOCTTY);
+	if (master < 0)
+		throw_errno("rs485: posix_openpt");
+	a.reset(new StreamTransport(master, baud));
+	if (::grantpt(master) < 0 || ::unlockpt(master) < 0)
+		throw_errno("rs485: grantpt/unlockpt");
+	const char* name = ::ptsname(master);
+	if (!name)
+		throw_errno("rs485: ptsname");
+	int slave = ::open(name, O_RDWR | O_NOCTTY);
+	if (slave < 0)
+		throw_errno("rs485: open pty");
+	b.reset(new StreamTransport(slave, baud));
+	make_raw(slave);										//Line discipline of the pair is on this side.
+}
+
+void StreamTransport::writeAll(const uint8_t* data, std::size_t len)
+{
+	while (len) {
+		ssize_t n = ::write(fd_, data, len);
+		if (n < 0) {
+			if (errno == EINTR)
+				continue;
+			if (errno != EAGAIN)
+				throw_errno("rs485: write");
+			pollfd p{fd_, POLLOUT, 0};
+			::poll(&p, 1, -1);
+			continue;
+		}
+		data += n;
+		len -= static_cast<std::size_t>(n);
+	}
+}
+
+void StreamTransport::send(const std::vector<uint8_t>& frame)
+{
+	std::vector<uint8_t> out;
+	out.reserve(frame.size() * 2 + 2);
+	for (std::size_t i = 0; i < frame.size(); ++i) {
+		if (i == 0) {
+			out.push_back(MARK);							//Address byte: 0xFF 0x00 prefix.
+			out.push_back(0);
+		} else if (frame[i] == MARK) {
+			out.push_back(MARK);							//Data byte 0xFF is doubled.
+		}
+		out.push_back(frame[i]);
+	}
+	writeAll(out.data(), out.size());
+}
+
+bool StreamTransport::fill(std::chrono::steady_clock::time_point deadline)
+{
+	if (pos_ < buf_.size())
+		return true;
+	buf_.clear();
+	pos_ = 0;
+	for (;;) {
+		pollfd p{fd_, POLLIN, 0};
+		int r = ::poll(&p, 1, poll_timeout(deadline));
+		if (r < 0) {
+			if (errno == EINTR)
+				continue;
+			throw_errno("rs485: poll");
+		}
+		if (r == 0)
+			return false;
+		uint8_t tmp[256];
+		ssize_t n = ::read(fd_, tmp, sizeof tmp);
+		if (n < 0) {
+			if (errno == EINTR || errno == EAGAIN)
+				continue;
+			throw_errno("rs485: read");
+		}
+		if (n == 0) {
+			if (std::chrono::steady_clock::now() >= deadline)
+				return false;
+			continue;
+		}
+		buf_.assign(tmp, tmp + n);
+		return true;
+	}
+}
+
+bool StreamTransport::next(uint8_t& byte, std::chrono::steady_clock::time_point deadline)
+{
+	if (!fill(deadline))
+		return false;
+	byte = buf_[pos_++];
+	return true;
+}
+
+RxStatus StreamTransport::receive(Symbol& sym, std::chrono::microseconds timeout)
+{
+	auto deadline = std::chrono::steady_clock::now() + timeout;
+	uint8_t b;
+	if (!next(b, deadline))
+		return RxStatus::Timeout;
+	if (b != MARK) {
+		sym = {b, false};
+		return RxStatus::Ok;
+	}
+	// Escape sequence: the rest of it is on its way, allow a few byte times for it.
+	deadline = std::max(deadline, std::chrono::steady_clock::now() + 4 * byteTime());
+	if (!next(b, deadline))
+		return RxStatus::Error;
+	if (b == MARK) {
+		sym = {MARK, false};
+		return RxStatus::Ok;
+	}
+	if (b != 0 || !next(b, deadline))
+		return RxStatus::Error;
+	sym = {b, true};
+	return RxStatus::Ok;
+}
+
+void StreamTransport::flush()
+{
+	buf_.clear();
+	pos_ = 0;
+	::tcflush(fd_, TCIFLUSH);
+}
+
+std::chrono::microseconds StreamTransport::byteTime() const
+{
+	return std::chrono::microseconds(11000000 / baud_ + 1);
+}
+
+/*--------------------------------------------------------------------------------------------------*
+ * SerialTransport
+ *--------------------------------------------------------------------------------------------------*/
+SerialTransport::SerialTransport(const std::string& device, unsigned baud, bool echo)
+	: StreamTransport(-1, baud), echo_(echo)
+{
+#ifndef CMSPAR
+	throw std::system_error(ENOTSUP, std::generic_category(), "rs485: no stick parity (CMSPAR)");
+#else
+	speed_t speed = baud_to_speed(baud);
+	fd_ = ::open(device.c_str(), O_RDWR | O_NOCTTY | O_NONBLOCK | O_CLOEXEC);
+	if (fd_ < 0)
+		throw_errno("rs485: open serial device");
+	termios t;
+	if (tcgetattr(fd_, &t) < 0)
+		throw_errno("rs485: tcgetattr");
+	cfmakeraw(&t);
+	t.c_cflag &= ~(CSIZE | CSTOPB | PARODD | CRTSCTS);
+	t.c_cflag |= CS8 | CLOCAL | CREAD | PARENB | CMSPAR;	//Space parity: 9th bit 0.
+	t.c_iflag |= INPCK | PARMRK;							//Mark address bytes with 0xFF 0x00.
+	t.c_cc[VMIN] = 0;
+	t.c_cc[VTIME] = 0;
+	cfsetispeed(&t, speed);
+	cfsetospeed(&t, speed);
+	if (tcsetattr(fd_, TCSANOW, &t) < 0)
+		throw_errno("rs485: tcsetattr");
+	::tcflush(fd_, TCIOFLUSH);
+#endif
+}
+
+void SerialTransport::setParity(bool mark)
+{
+#ifdef CMSPAR
+	termios t;
+	if (tcgetattr(fd_, &t) < 0)
+		throw_errno("rs485: tcgetattr");
+	if (mark)
+		t.c_cflag |= PARODD;								//CMSPAR + PARODD: mark parity.
+	else
+		t.c_cflag &= ~PARODD;
+	if (tcsetattr(fd_, TCSADRAIN, &t) < 0)					//After the bytes already written.
+		throw_errno("rs485: tcsetattr");
+#else
+	(void)mark;
+#endif
+}
+
+void SerialTransport::send(const std::vector<uint8_t>& frame)
+{
+	if (frame.empty())
+		return;
+	setParity(true);										//Address byte with 9th bit set,
+	writeAll(frame.data(), 1);
+	setParity(false);										//  the rest with 9th bit clear.
+	writeAll(frame.data() + 1, frame.size() - 1);
+	::tcdrain(fd_);
+	if (echo_) {
+		// Drop our own bytes; allow the whole frame time for them to come back.
+		Symbol sym;
+		auto timeout = byteTime() * static_cast<long>(frame.size() + 2);
+		for (std::size_t i = 0; i < frame.size(); ++i)
+			if (StreamTransport::receive(sym, timeout) == RxStatus::Timeout)
+				break;
+	}
+}
+
+} // namespace rs485
@@ -0,0 +1,884 @@
+#include "avrsim.h"
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+
+namespace rs485 {
+
+namespace {
+
+// I/O registers of the ATmega328P used by rs485boot (data space addresses).
+constexpr uint16_t PIND = 0x29, DDRD = 0x2A, PORTD = 0x2B;
+constexpr uint16_t EECR = 0x3F, EEDR = 0x40, EEARL = 0x41, EEARH = 0x42;
+constexpr uint16_t MCUSR = 0x54, SPMCSR = 0x57, SPL = 0x5D, SPH = 0x5E, SREG = 0x5F;
+constexpr uint16_t WDTCSR = 0x60;
+constexpr uint16_t UCSR0A = 0xC0, UCSR0B = 0xC1, UCSR0C = 0xC2, UBRR0L = 0xC4, UBRR0H = 0xC5;
+constexpr uint16_t UDR0 = 0xC6;
+
+// Register bits.
+constexpr uint8_t EERE = 0, EEPE = 1, EEMPE = 2;
+constexpr uint8_t PORF = 0, WDRF = 3;
+constexpr uint8_t SPMEN = 0, PGERS = 1, PGWRT = 2, RWWSRE = 4, RWWSB = 6;
+constexpr uint8_t WDE = 3, WDCE = 4, WDP3 = 5;
+constexpr uint8_t MPCM0 = 0, U2X0 = 1, UPE0 = 2, DOR0 = 3, FE0 = 4, UDRE0 = 5, TXC0 = 6, RXC0 = 7;
+constexpr uint8_t TXB80 = 0, RXB80 = 1, UCSZ02 = 2, TXEN0 = 3, RXEN0 = 4;
+constexpr uint8_t UDRIE0 = 5, TXCIE0 = 6, RXCIE0 = 7;
+constexpr uint8_t DIR_PIN = 2;											//PD2, RS485 direction.
+
+// SREG bits.
+constexpr unsigned C = 0, Z = 1, N = 2, V = 3, S = 4, H = 5, T = 6, I = 7;
+
+constexpr uint32_t PAGE_BUSY_US = 4000;								//Page erase/write time.
+
+bool bit(unsigned value, unsigned n)
+{
+	return (value >> n) & 1;
+}
+
+// Length of a frame from its first bytes (address, command, length), 0 while unknown.
+size_t frameLength(const std::vector<Symbol>& frame)
+{
+	if (frame.size() < 3)
+		return 0;
+	return 5 + (frame[2].data & 0x0F);
+}
+
+}
+
+AvrSim::AvrSim(Transport& bus, uint32_t fcpu, uint32_t bootStart, unsigned baud)
+	: flash(FLASH_SIZE, 0xFF), eeprom(EEPROM_SIZE, 0xFF), bus_(bus), fcpu_(fcpu),
+	  bootStart_(bootStart), baud_(baud), pageBuf_(PAGE_SIZE, 0xFF)
+{
+}
+
+AvrSim::~AvrSim()
+{
+	stop();
+}
+
+void AvrSim::start(Reset reset)
+{
+	stop();
+	{
+		std::lock_guard<std::mutex> lock(errorMutex_);
+		error_.clear();
+	}
+	// Registers hold garbage after power-on.
+	for (unsigned r = 0; r < 32; r++)
+		data_[r] = static_cast<uint8_t>(std::rand());
+	data_[MCUSR] = 0;
+	this->reset(reset);
+	stop_ = false;
+	thread_ = std::thread([this] { run(); });
+}
+
+void AvrSim::stop()
+{
+	stop_ = true;
+	if (thread_.joinable())
+		thread_.join();
+}
+
+void AvrSim::setLoss(std::function<bool(const std::vector<Symbol>&)> lose)
+{
+	lose_ = std::move(lose);
+}
+
+std::string AvrSim::error() const
+{
+	std::lock_guard<std::mutex> lock(errorMutex_);
+	return error_;
+}
+
+void AvrSim::fail(const std::string& what)
+{
+	char pc[16];
+	std::snprintf(pc, sizeof(pc), " (PC 0x%05X)", static_cast<unsigned>(pc_ * 2));
+	std::lock_guard<std::mutex> lock(errorMutex_);
+	if (error_.empty())
+		error_ = what + pc;
+}
+
+void AvrSim::reset(Reset reset)
+{
+	uint8_t mcusr = data_[MCUSR];
+	for (unsigned a = 0x20; a <= RAMEND; a++)
+		data_[a] = 0;
+	if (reset == Reset::Watchdog) {
+		data_[MCUSR] = mcusr | 1 << WDRF;
+		data_[WDTCSR] = 1 << WDE;										//WDRF keeps WDE set.
+	} else {
+		data_[MCUSR] = 1 << PORF;
+		data_[WDTCSR] = 0;
+	}
+	data_[SPL] = RAMEND & 0xFF;
+	data_[SPH] = RAMEND >> 8;
+	data_[UCSR0A] = 1 << UDRE0;
+	data_[UCSR0C] = 0x06;												//8N1.
+	pc_ = bootStart_ / 2;												//BOOTRST.
+	halted_ = false;
+	appStarted_ = false;
+	wdtStart_ = cycles_;
+	wdceUntil_ = 0;
+	spmUntil_ = 0;
+	spmBusy_ = 0;
+	rwwBusy_ = false;
+	pageBuf_.assign(PAGE_SIZE, 0xFF);
+	wire_.clear();
+	inFrame_.clear();
+	rxFifo_.clear();
+	dor_ = false;
+	txFull_ = txBusy_ = txc_ = false;
+	outFrame_.clear();
+	resets_++;
+}
+
+void AvrSim::run()
+{
+	using Clock = std::chrono::steady_clock;
+	auto t0 = Clock::now();
+	uint64_t c0 = cycles_;
+	while (!stop_) {
+		receiveBus();
+		auto us = std::chrono::duration_cast<std::chrono::microseconds>(Clock::now() - t0);
+		uint64_t due = c0 + static_cast<uint64_t>(us.count()) * fcpu_ / 1000000;
+		while (cycles_ < due) {
+			if (halted_)
+				cycles_ = due;
+			else
+				cycles_ += step();
+			peripherals();
+		}
+		std::this_thread::sleep_for(std::chrono::microseconds(100));
+	}
+}
+
+// Bytes from the Master, kept on the wire until the receiver gets them. The frames are collected
+// first, so a lost frame can be taken off as a whole.
+void AvrSim::receiveBus()
+{
+	Symbol sym;
+	for (;;) {
+		RxStatus st = bus_.receive(sym, std::chrono::microseconds(0));
+		if (st == RxStatus::Timeout)
+			break;
+		if (st != RxStatus::Ok)
+			continue;
+		if (wire_.empty() && inFrame_.empty() && rxNext_ < cycles_ + byteCycles())
+			rxNext_ = cycles_ + byteCycles();						//First byte after a pause.
+		if (sym.address && !inFrame_.empty()) {
+			wire_.insert(wire_.end(), inFrame_.begin(), inFrame_.end());
+			inFrame_.clear();
+		}
+		inFrame_.push_back(sym);
+		size_t len = frameLength(inFrame_);
+		if (len && inFrame_.size() >= len) {
+			if (!lose_ || !lose_(inFrame_))
+				wire_.insert(wire_.end(), inFrame_.begin(), inFrame_.end());
+			inFrame_.clear();
+		}
+	}
+}
+
+uint32_t AvrSim::byteCycles() const
+{
+	unsigned ubrr = (data_[UBRR0H] << 8 | data_[UBRR0L]) & 0x0FFF;
+	return 11 * (bit(data_[UCSR0A], U2X0) ? 8 : 16) * (ubrr + 1);
+}
+
+// 9 data bits, no parity, 1 stop bit, at the bus baud rate (within 2%).
+bool AvrSim::formatOk() const
+{
+	unsigned ubrr = (data_[UBRR0H] << 8 | data_[UBRR0L]) & 0x0FFF;
+	double baud = static_cast<double>(fcpu_) / ((bit(data_[UCSR0A], U2X0) ? 8 : 16) * (ubrr + 1));
+	uint8_t c = data_[UCSR0C];
+	return bit(data_[UCSR0B], UCSZ02) && (c & 0xFE) == 0x06 && baud > baud_ * 0.98 &&
+		baud < baud_ * 1.02;
+}
+
+bool AvrSim::transmitting() const
+{
+	return bit(data_[DDRD], DIR_PIN) && bit(data_[PORTD], DIR_PIN);
+}
+
+void AvrSim::peripherals()
+{
+	// Receiver: the next byte on the wire arrives one byte time after the previous one.
+	if (!wire_.empty() && cycles_ >= rxNext_) {
+		Symbol sym = wire_.front();
+		wire_.pop_front();
+		rxNext_ = cycles_ + byteCycles();
+		if (transmitting()) {
+			// The transceiver doesn't listen while driving the bus.
+		} else if (bit(data_[UCSR0B], RXEN0)) {
+			if (rxFifo_.size() >= 2)
+				dor_ = true;
+			else if (!bit(data_[UCSR0A], MPCM0) || sym.address)
+				rxFifo_.push_back(Rx{sym, !formatOk()});
+		}
+	}
+
+	// Transmitter.
+	if (txBusy_ && cycles_ >= txDone_) {
+		if (!transmitting())
+			fail("byte sent with the direction pin set to receive");
+		else
+			outFrame_.push_back(txShift_);
+		txBusy_ = false;
+		if (txFull_) {
+			txShift_ = txBuf_;
+			txFull_ = false;
+			txBusy_ = true;
+			txDone_ = cycles_ + byteCycles();
+		} else {
+			txc_ = true;
+		}
+	}
+
+	// Self-programming.
+	if (spmBusy_ && cycles_ >= spmBusy_)
+		spmBusy_ = 0;
+
+	// Watchdog: 2048 cycles of the 128 kHz oscillator times 2^WDP.
+	uint8_t wdt = data_[WDTCSR];
+	if (bit(wdt, WDE)) {
+		unsigned wdp = (wdt & 0x07) | (bit(wdt, WDP3) << 3);
+		uint64_t timeout = (static_cast<uint64_t>(fcpu_) * 2048 / 128000) << wdp;
+		if (cycles_ - wdtStart_ >= timeout)
+			reset(Reset::Watchdog);
+	}
+}
+
+uint8_t AvrSim::read(uint16_t addr)
+{
+	if (addr > RAMEND) {
+		fail("read outside SRAM");
+		return 0;
+	}
+	switch (addr) {
+	case PIND:
+		return data_[PORTD] & data_[DDRD];
+	case EECR:
+		return data_[EECR] & ~(1 << EERE | 1 << EEPE);
+	case SPMCSR: {
+		uint8_t v = data_[SPMCSR] & ~(1 << SPMEN | 1 << RWWSB);
+		if (spmBusy_ || cycles_ < spmUntil_)
+			v |= 1 << SPMEN;
+		if (rwwBusy_)
+			v |= 1 << RWWSB;
+		return v;
+	}
+	case UCSR0A: {
+		uint8_t v = data_[UCSR0A] & (1 << U2X0 | 1 << MPCM0);
+		if (!txFull_)
+			v |= 1 << UDRE0;
+		if (txc_)
+			v |= 1 << TXC0;
+		if (!rxFifo_.empty()) {
+			v |= 1 << RXC0;
+			if (rxFifo_.front().fe)
+				v |= 1 << FE0;
+			if (dor_ && rxFifo_.size() == 1)
+				v |= 1 << DOR0;
+		}
+		return v;
+	}
+	case UCSR0B: {
+		uint8_t v = data_[UCSR0B] & ~(1 << RXB80);
+		if (!rxFifo_.empty() && rxFifo_.front().sym.address)
+			v |= 1 << RXB80;
+		return v;
+	}
+	case UDR0: {
+		if (rxFifo_.empty())
+			return 0;
+		uint8_t v = rxFifo_.front().sym.data;
+		rxFifo_.pop_front();
+		if (rxFifo_.empty())
+			dor_ = false;
+		return v;
+	}
+	default:
+		return data_[addr];
+	}
+}
+
+void AvrSim::write(uint16_t addr, uint8_t value)
+{
+	if (addr > RAMEND) {
+		fail("write outside SRAM");
+		return;
+	}
+	switch (addr) {
+	case PORTD:
+	case DDRD: {
+		bool was = transmitting();
+		data_[addr] = value;
+		if (was && !transmitting()) {
+			if (txBusy_ || txFull_)
+				fail("direction pin set to receive while sending");
+			if (!outFrame_.empty()) {
+				std::vector<uint8_t> frame;
+				bool ok = outFrame_[0].address;
+				for (size_t i = 0; i < outFrame_.size(); i++) {
+					frame.push_back(outFrame_[i].data);
+					ok = ok && (i == 0 || !outFrame_[i].address);
+				}
+				if (!ok)
+					fail("frame sent without exactly one address byte in front");
+				bus_.send(frame);
+				outFrame_.clear();
+			}
+		}
+		break;
+	}
+	case EECR:
+		data_[EECR] = value & ~(1 << EERE | 1 << EEPE);
+		if (bit(value, EERE)) {
+			unsigned a = (data_[EEARH] << 8 | data_[EEARL]) & (EEPROM_SIZE - 1);
+			data_[EEDR] = eeprom[a];
+		}
+		if (bit(value, EEPE))
+			fail("EEPROM write");
+		break;
+	case MCUSR:
+		data_[MCUSR] &= value;										//Flags are cleared by writing 0.
+		break;
+	case SPMCSR:
+		data_[SPMCSR] = value & ~(1 << RWWSB);
+		spmUntil_ = cycles_ + 4;
+		break;
+	case WDTCSR: {
+		uint8_t wdt = data_[WDTCSR];
+		if (bit(value, WDCE) && bit(value, WDE)) {
+			wdceUntil_ = cycles_ + 4;
+			data_[WDTCSR] = wdt | 1 << WDCE;
+		} else if (cycles_ < wdceUntil_) {
+			// Timed sequence: WDE and the prescaler may change, but WDRF keeps WDE set.
+			value &= ~(1 << WDCE);
+			if (bit(data_[MCUSR], WDRF))
+				value |= 1 << WDE;
+			data_[WDTCSR] = value;
+			wdceUntil_ = 0;
+		} else {
+			data_[WDTCSR] = (wdt & ~0xC0) | (value & 0xC0) | (value & 1 << WDE);
+		}
+		if (value & 0x40)
+			fail("watchdog interrupt");
+		break;
+	}
+	case UCSR0A:
+		data_[UCSR0A] = value & (1 << U2X0 | 1 << MPCM0);
+		if (bit(value, TXC0))
+			txc_ = false;
+		break;
+	case UCSR0B:
+		data_[UCSR0B] = value & ~(1 << RXB80);
+		if (value & (1 << RXCIE0 | 1 << TXCIE0 | 1 << UDRIE0))
+			fail("USART interrupt");
+		if (!bit(value, RXEN0)) {
+			rxFifo_.clear();
+			dor_ = false;
+		}
+		break;
+	case UDR0:
+		if (!bit(data_[UCSR0B], TXEN0))
+			break;
+		if (!formatOk())
+			fail("byte sent with the USART not set to 9N1 at the bus baud rate");
+		if (!txBusy_) {
+			txShift_ = Symbol{value, bit(data_[UCSR0B], TXB80)};
+			txBusy_ = true;
+			txDone_ = cycles_ + byteCycles();
+		} else if (!txFull_) {
+			txBuf_ = Symbol{value, bit(data_[UCSR0B], TXB80)};
+			txFull_ = true;
+		} else {
+			fail("UDR0 written with UDRE0 clear");
+		}
+		break;
+	case SREG:
+	case SPL:
+	case SPH:
+	default:
+		data_[addr] = value;
+		break;
+	}
+}
+
+void AvrSim::setWord(unsigned r, uint16_t value)
+{
+	data_[r] = value & 0xFF;
+	data_[r + 1] = value >> 8;
+}
+
+void AvrSim::setFlag(unsigned n, bool on)
+{
+	if (on)
+		data_[SREG] |= 1 << n;
+	else
+		data_[SREG] &= ~(1 << n);
+}
+
+uint16_t AvrSim::fetch(uint32_t pc) const
+{
+	uint32_t a = (pc * 2) % FLASH_SIZE;
+	return static_cast<uint16_t>(flash[a] | flash[a + 1] << 8);
+}
+
+uint8_t AvrSim::lpm(uint32_t addr)
+{
+	addr %= FLASH_SIZE;
+	if (addr < bootStart_ && rwwBusy_) {
+		fail("LPM from the RWW section before RWWSRE");
+		return 0xFF;
+	}
+	return flash[addr];
+}
+
+void AvrSim::spm()
+{
+	uint8_t cmd = data_[SPMCSR] & 0x1F;
+	uint16_t z = word(30);
+	data_[SPMCSR] &= ~0x1F;
+	bool armed = cycles_ < spmUntil_;
+	spmUntil_ = 0;
+	if (!armed || !bit(cmd, SPMEN)) {
+		fail("SPM without SPMEN set just before");
+		return;
+	}
+	if (spmBusy_) {
+		fail("SPM while a page erase/write is in progress");
+		return;
+	}
+	uint32_t page = z & ~(PAGE_SIZE - 1);
+	if ((cmd & (1 << PGERS | 1 << PGWRT)) && page >= bootStart_) {
+		fail("page erase/write in the boot section");
+		return;
+	}
+	uint64_t busy = cycles_ + static_cast<uint64_t>(fcpu_) * PAGE_BUSY_US / 1000000;
+	switch (cmd) {
+	case 1 << SPMEN:												//Fill the page buffer.
+		pageBuf_[z & (PAGE_SIZE - 2)] = data_[0];
+		pageBuf_[(z & (PAGE_SIZE - 2)) + 1] = data_[1];
+		break;
+	case 1 << PGERS | 1 << SPMEN:
+		for (uint32_t i = 0; i < PAGE_SIZE; i++)
+			flash[page + i] = 0xFF;
+		spmBusy_ = busy;
+		rwwBusy_ = true;
+		break;
+	case 1 << PGWRT | 1 << SPMEN:
+		for (uint32_t i = 0; i < PAGE_SIZE; i++)
+			flash[page + i] &= pageBuf_[i];
+		pageBuf_.assign(PAGE_SIZE, 0xFF);
+		spmBusy_ = busy;
+		rwwBusy_ = true;
+		break;
+	case 1 << RWWSRE | 1 << SPMEN:
+		rwwBusy_ = false;
+		pageBuf_.assign(PAGE_SIZE, 0xFF);
+		break;
+	default:
+		fail("unsupported SPM command");
+		break;
+	}
+}
+
+void AvrSim::push(uint8_t value)
+{
+	uint16_t sp = static_cast<uint16_t>(data_[SPL] | data_[SPH] << 8);
+	if (sp < 0x100)
+		fail("stack overflow");
+	write(sp, value);
+	sp--;
+	data_[SPL] = sp & 0xFF;
+	data_[SPH] = sp >> 8;
+}
+
+uint8_t AvrSim::pop()
+{
+	uint16_t sp = static_cast<uint16_t>(data_[SPL] | data_[SPH] << 8) + 1;
+	data_[SPL] = sp & 0xFF;
+	data_[SPH] = sp >> 8;
+	return read(sp);
+}
+
+// Execute one instruction, return its cycles.
+uint32_t AvrSim::step()
+{
+	if (pc_ * 2 < bootStart_) {
+		if (rwwBusy_)
+			fail("jump to the RWW section before RWWSRE");
+		appStarted_ = true;
+		halted_ = true;
+		return 1;
+	}
+	uint16_t op = fetch(pc_);
+	uint32_t next = pc_ + 1;
+	uint32_t cycles = 1;
+	unsigned d = (op >> 4) & 0x1F;
+	unsigned r = (op & 0x0F) | ((op >> 5) & 0x10);
+	unsigned dh = 16 + ((op >> 4) & 0x0F);
+	uint8_t k = static_cast<uint8_t>((op & 0x0F) | ((op >> 4) & 0xF0));
+	uint8_t sreg = data_[SREG];
+
+	auto logic = [&](unsigned rd, uint8_t res) {
+		reg(rd) = res;
+		setFlag(V, false);
+		setFlag(N, bit(res, 7));
+		setFlag(Z, res == 0);
+		setFlag(S, bit(res, 7));
+	};
+	auto add = [&](unsigned rd, uint8_t b, bool carry) {
+		uint8_t a = reg(rd);
+		uint8_t res = static_cast<uint8_t>(a + b + carry);
+		reg(rd) = res;
+		setFlag(H, ((a & b) | (b & ~res) | (~res & a)) & 0x08);
+		setFlag(V, ((a & b & ~res) | (~a & ~b & res)) & 0x80);
+		setFlag(C, ((a & b) | (b & ~res) | (~res & a)) & 0x80);
+		setFlag(N, bit(res, 7));
+		setFlag(Z, res == 0);
+		setFlag(S, flag(N) ^ flag(V));
+	};
+	auto sub = [&](unsigned rd, uint8_t b, bool carry, bool keepZ, bool store) {
+		uint8_t a = reg(rd);
+		uint8_t res = static_cast<uint8_t>(a - b - carry);
+		if (store)
+			reg(rd) = res;
+		setFlag(H, ((~a & b) | (b & res) | (res & ~a)) & 0x08);
+		setFlag(V, ((a & ~b & ~res) | (~a & b & res)) & 0x80);
+		setFlag(C, ((~a & b) | (b & res) | (res & ~a)) & 0x80);
+		setFlag(N, bit(res, 7));
+		setFlag(Z, res == 0 && (!keepZ || bit(sreg, Z)));
+		setFlag(S, flag(N) ^ flag(V));
+	};
+	auto skip = [&]() {
+		uint16_t nop = fetch(next);
+		bool two = (nop & 0xFE0E) == 0x940C || (nop & 0xFE0E) == 0x940E ||
+			(nop & 0xFC0F) == 0x9000;
+		next += two ? 2 : 1;
+		cycles += two ? 2 : 1;
+	};
+	auto pointer = [&](unsigned mode, unsigned& p) {
+		// Returns the address for ld/st through X, Y or Z with post-increment/pre-decrement.
+		p = mode >= 0x0C ? 26 : (mode >= 0x08 ? 28 : 30);
+		uint16_t a = word(p);
+		if ((mode & 3) == 2) {
+			a--;
+			setWord(p, a);
+		}
+		return a;
+	};
+	auto postInc = [&](unsigned mode, unsigned p) {
+		if ((mode & 3) == 1)
+			setWord(p, word(p) + 1);
+	};
+
+	switch (op >> 12) {
+	case 0x0:
+		if (op == 0x0000) {
+			// nop
+		} else if ((op & 0xFF00) == 0x0100) {						//movw
+			reg(((op >> 4) & 0x0F) * 2) = reg((op & 0x0F) * 2);
+			reg(((op >> 4) & 0x0F) * 2 + 1) = reg((op & 0x0F) * 2 + 1);
+		} else if ((op & 0xFF00) == 0x0200) {						//muls
+			int16_t res = static_cast<int16_t>(static_cast<int8_t>(reg(dh)) *
+				static_cast<int8_t>(reg(16 + (op & 0x0F))));
+			setWord(0, static_cast<uint16_t>(res));
+			setFlag(C, res & 0x8000);
+			setFlag(Z, res == 0);
+			cycles = 2;
+		} else if ((op & 0xFC00) == 0x0400) {						//cpc
+			sub(d, reg(r), bit(sreg, C), true, false);
+		} else if ((op & 0xFC00) == 0x0800) {						//sbc
+			sub(d, reg(r), bit(sreg, C), true, true);
+		} else if ((op & 0xFC00) == 0x0C00) {						//add
+			add(d, reg(r), false);
+		} else {
+			fail("unsupported instruction");
+		}
+		break;
+	case 0x1:
+		if ((op & 0xFC00) == 0x1000) {								//cpse
+			if (reg(d) == reg(r))
+				skip();
+		} else if ((op & 0xFC00) == 0x1400) {						//cp
+			sub(d, reg(r), false, false, false);
+		} else if ((op & 0xFC00) == 0x1800) {						//sub
+			sub(d, reg(r), false, false, true);
+		} else {													//adc
+			add(d, reg(r), bit(sreg, C));
+		}
+		break;
+	case 0x2:
+		if ((op & 0xFC00) == 0x2000)								//and
+			logic(d, reg(d) & reg(r));
+		else if ((op & 0xFC00) == 0x2400)							//eor
+			logic(d, reg(d) ^ reg(r));
+		else if ((op & 0xFC00) == 0x2800)							//or
+			logic(d, reg(d) | reg(r));
+		else														//mov
+			reg(d) = reg(r);
+		break;
+	case 0x3:														//cpi
+		sub(dh, k, false, false, false);
+		break;
+	case 0x4:														//sbci
+		sub(dh, k, bit(sreg, C), true, true);
+		break;
+	case 0x5:														//subi
+		sub(dh, k, false, false, true);
+		break;
+	case 0x6:														//ori
+		logic(dh, reg(dh) | k);
+		break;
+	case 0x7:														//andi
+		logic(dh, reg(dh) & k);
+		break;
+	case 0x8:
+	case 0xA: {														//ldd/std
+		unsigned q = ((op >> 8) & 0x20) | ((op >> 7) & 0x18) | (op & 0x07);
+		uint16_t a = static_cast<uint16_t>(word(bit(op, 3) ? 28 : 30) + q);
+		if (bit(op, 9))
+			write(a, reg(d));
+		else
+			reg(d) = read(a);
+		cycles = 2;
+		break;
+	}
+	case 0x9:
+		if ((op & 0xFC00) == 0x9000) {								//lds/sts, ld/st, lpm, push/pop
+			bool store = bit(op, 9);
+			unsigned mode = op & 0x0F;
+			cycles = 2;
+			if (mode == 0x0) {
+				uint16_t a = fetch(next);
+				next++;
+				if (store)
+					write(a, reg(d));
+				else
+					reg(d) = read(a);
+			} else if (!store && (mode == 0x4 || mode == 0x5)) {	//lpm Z/Z+
+				reg(d) = lpm(word(30));
+				if (mode == 0x5)
+					setWord(30, word(30) + 1);
+				cycles = 3;
+			} else if (mode == 0xF) {
+				if (store)
+					push(reg(d));
+				else
+					reg(d) = pop();
+			} else if (mode == 0x1 || mode == 0x2 || mode == 0x9 || mode == 0xA ||
+				mode == 0xC || mode == 0xD || mode == 0xE) {
+				unsigned p;
+				uint16_t a = pointer(mode, p);
+				if (store)
+					write(a, reg(d));
+				else
+					reg(d) = read(a);
+				postInc(mode, p);
+			} else {
+				fail("unsupported instruction");
+			}
+		} else if ((op & 0xFE08) == 0x9400 || (op & 0xFE0F) == 0x940A) {	//one operand
+			uint8_t a = reg(d);
+			uint8_t res;
+			switch (op & 0x0F) {
+			case 0x0:												//com
+				logic(d, static_cast<uint8_t>(~a));
+				setFlag(C, true);
+				break;
+			case 0x1:												//neg
+				res = static_cast<uint8_t>(0 - a);
+				reg(d) = res;
+				setFlag(H, (res | a) & 0x08);
+				setFlag(V, res == 0x80);
+				setFlag(C, res != 0);
+				setFlag(N, bit(res, 7));
+				setFlag(Z, res == 0);
+				setFlag(S, flag(N) ^ flag(V));
+				break;
+			case 0x2:												//swap
+				reg(d) = static_cast<uint8_t>(a << 4 | a >> 4);
+				break;
+			case 0x3:												//inc
+				res = static_cast<uint8_t>(a + 1);
+				reg(d) = res;
+				setFlag(V, res == 0x80);
+				setFlag(N, bit(res, 7));
+				setFlag(Z, res == 0);
+				setFlag(S, flag(N) ^ flag(V));
+				break;
+			case 0x5:												//asr
+			case 0x6:												//lsr
+			case 0x7:												//ror
+				if ((op & 0x0F) == 0x5)
+					res = static_cast<uint8_t>((a >> 1) | (a & 0x80));
+				else if ((op & 0x0F) == 0x6)
+					res = a >> 1;
+				else
+					res = static_cast<uint8_t>((a >> 1) | (bit(sreg, C) << 7));
+				reg(d) = res;
+				setFlag(C, a & 1);
+				setFlag(N, bit(res, 7));
+				setFlag(Z, res == 0);
+				setFlag(V, flag(N) ^ flag(C));
+				setFlag(S, flag(N) ^ flag(V));
+				break;
+			case 0xA:												//dec
+				res = static_cast<uint8_t>(a - 1);
+				reg(d) = res;
+				setFlag(V, res == 0x7F);
+				setFlag(N, bit(res, 7));
+				setFlag(Z, res == 0);
+				setFlag(S, flag(N) ^ flag(V));
+				break;
+			default:
+				fail("unsupported instruction");
+				break;
+			}
+		} else if ((op & 0xFF0F) == 0x9408) {						//bset/bclr
+			setFlag((op >> 4) & 7, !bit(op, 7));
+			if (((op >> 4) & 7) == I && !bit(op, 7))
+				fail("interrupts enabled");
+		} else if (op == 0x9409 || op == 0x9509) {					//ijmp/icall
+			if (op == 0x9509) {
+				push(next & 0xFF);
+				push((next >> 8) & 0xFF);
+				cycles = 3;
+			} else {
+				cycles = 2;
+			}
+			next = word(30);
+		} else if (op == 0x9508) {									//ret
+			next = pop() << 8;
+			next |= pop();
+			cycles = 4;
+		} else if (op == 0x9588) {									//sleep
+			fail("sleep");
+		} else if (op == 0x95A8) {									//wdr
+			wdtStart_ = cycles_;
+		} else if (op == 0x95C8) {									//lpm (R0)
+			reg(0) = lpm(word(30));
+			cycles = 3;
+		} else if (op == 0x95E8) {									//spm
+			spm();
+			cycles = 4;
+		} else if ((op & 0xFE0E) == 0x940C || (op & 0xFE0E) == 0x940E) {	//jmp/call
+			uint32_t a = static_cast<uint32_t>(((op >> 3) & 0x3E) | (op & 1)) << 16 | fetch(next);
+			next++;
+			if (bit(op, 1)) {
+				push(next & 0xFF);
+				push((next >> 8) & 0xFF);
+				cycles = 4;
+			} else {
+				cycles = 3;
+			}
+			next = a;
+		} else if ((op & 0xFE00) == 0x9600) {						//adiw/sbiw
+			unsigned rd = 24 + ((op >> 3) & 0x06);
+			uint8_t kk = static_cast<uint8_t>((op & 0x0F) | ((op >> 2) & 0x30));
+			uint16_t a = word(rd);
+			uint16_t res;
+			if (bit(op, 8)) {
+				res = static_cast<uint16_t>(a - kk);
+				setFlag(V, (a & ~res) & 0x8000);
+				setFlag(C, (res & ~a) & 0x8000);
+			} else {
+				res = static_cast<uint16_t>(a + kk);
+				setFlag(V, (~a & res) & 0x8000);
+				setFlag(C, (~res & a) & 0x8000);
+			}
+			setWord(rd, res);
+			setFlag(N, res & 0x8000);
+			setFlag(Z, res == 0);
+			setFlag(S, flag(N) ^ flag(V));
+			cycles = 2;
+		} else if ((op & 0xFC00) == 0x9800) {						//cbi/sbic/sbi/sbis
+			uint16_t a = static_cast<uint16_t>(0x20 + ((op >> 3) & 0x1F));
+			unsigned b = op & 7;
+			switch ((op >> 8) & 3) {
+			case 0:
+				write(a, read(a) & ~(1 << b));
+				cycles = 2;
+				break;
+			case 1:
+				if (!bit(read(a), b))
+					skip();
+				break;
+			case 2:
+				write(a, read(a) | 1 << b);
+				cycles = 2;
+				break;
+			case 3:
+				if (bit(read(a), b))
+					skip();
+				break;
+			}
+		} else if ((op & 0xFC00) == 0x9C00) {						//mul
+			uint16_t res = static_cast<uint16_t>(reg(d) * reg(r));
+			setWord(0, res);
+			setFlag(C, res & 0x8000);
+			setFlag(Z, res == 0);
+			cycles = 2;
+		} else {
+			fail("unsupported instruction");
+		}
+		break;
+	case 0xB: {														//in/out
+		uint16_t a = static_cast<uint16_t>(0x20 + (((op >> 5) & 0x30) | (op & 0x0F)));
+		if (bit(op, 11))
+			write(a, reg(d));
+		else
+			reg(d) = read(a);
+		break;
+	}
+	case 0xC:														//rjmp
+	case 0xD: {														//rcall
+		int32_t off = op & 0x0FFF;
+		if (off & 0x0800)
+			off -= 0x1000;
+		if (op >> 12 == 0xD) {
+			push(next & 0xFF);
+			push((next >> 8) & 0xFF);
+			cycles = 3;
+		} else {
+			cycles = 2;
+		}
+		next = static_cast<uint32_t>(static_cast<int32_t>(next) + off);
+		break;
+	}
+	case 0xE:														//ldi
+		reg(dh) = k;
+		break;
+	case 0xF:
+		if ((op & 0xF800) == 0xF000) {								//brbs/brbc
+			int32_t off = (op >> 3) & 0x7F;
+			if (off & 0x40)
+				off -= 0x80;
+			if (bit(sreg, op & 7) != bit(op, 10)) {
+				next = static_cast<uint32_t>(static_cast<int32_t>(next) + off);
+				cycles = 2;
+			}
+		} else if ((op & 0xFE08) == 0xF800) {						//bld
+			if (bit(sreg, T))
+				reg(d) |= 1 << (op & 7);
+			else
+				reg(d) &= ~(1 << (op & 7));
+		} else if ((op & 0xFE08) == 0xFA00) {						//bst
+			setFlag(T, bit(reg(d), op & 7));
+		} else if ((op & 0xFC08) == 0xFC00) {						//sbrc/sbrs
+			if (bit(reg(d), op & 7) == bit(op, 9))
+				skip();
+		} else {
+			fail("unsupported instruction");
+		}
+		break;
+	}
+	pc_ = next & (FLASH_SIZE / 2 - 1);
+	return cycles;
+}
+
+}
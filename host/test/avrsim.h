@@ -0,0 +1,140 @@
+/*==================================================================================================*
+ *SYNOPSIS:
+ *	Instruction set simulator of an ATmega328P, to run the rs485boot bootloader as assembled from
+ *	src/rs485boot/rs485boot.S against the host library. It has what the bootloader uses: the CPU
+ *	(no interrupts), SRAM, EEPROM, self-programming (SPM with the page erase and write times and
+ *	the Read-While-Write section), MCUSR and the watchdog, and USART0 with 9-bit frames, polled.
+ *
+ *	The simulator runs in real time at F_CPU in its own thread, so the timeouts of both sides
+ *	apply as on the bus. The bytes of the Master reach the receiver one byte time apart (lost on
+ *	an overrun, with a frame error if the USART isn't set to 9N1 at the bus baud rate); the bytes
+ *	sent go out on the transport as one frame when the direction pin (PD2) is switched back to
+ *	receive, and only count while it is set to transmit.
+ *==================================================================================================*/
+#ifndef RS485_AVRSIM_H
+#define RS485_AVRSIM_H
+
+#include <rs485/frame.h>
+#include <rs485/transport.h>
+
+#include <atomic>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace rs485 {
+
+class AvrSim {
+public:
+	static constexpr uint32_t FLASH_SIZE = 0x8000;
+	static constexpr uint32_t PAGE_SIZE = 128;
+	static constexpr uint32_t EEPROM_SIZE = 1024;
+	static constexpr uint16_t RAMEND = 0x08FF;
+
+	// Reset sources (MCUSR flags).
+	enum class Reset { PowerOn, Watchdog };
+
+	// Simulates the ATmega328P at fcpu with BOOTRST programmed (reset at bootStart, a byte
+	// address), on the bus side of the transport at baud.
+	AvrSim(Transport& bus, uint32_t fcpu, uint32_t bootStart, unsigned baud = 38400);
+	~AvrSim();
+	AvrSim(const AvrSim&) = delete;
+	AvrSim& operator=(const AvrSim&) = delete;
+
+	// Flash and EEPROM contents; only change them while stopped.
+	std::vector<uint8_t> flash;
+	std::vector<uint8_t> eeprom;
+
+	// Reset the MCU and run it until stop. A watchdog reset leaves the watchdog running (WDRF).
+	void start(Reset reset = Reset::PowerOn);
+	void stop();
+
+	// Frames from the Master for which lose returns true are lost on the way to the receiver.
+	void setLoss(std::function<bool(const std::vector<Symbol>&)> lose);
+
+	// Number of resets (start and watchdog) and whether the program jumped to the application
+	// section, where the simulation stops (the bootloader started the application).
+	unsigned resets() const { return resets_; }
+	bool appStarted() const { return appStarted_; }
+	// First thing the program did that the MCU (or the bus) doesn't allow, empty if none.
+	std::string error() const;
+
+private:
+	Transport& bus_;
+	const uint32_t fcpu_;
+	const uint32_t bootStart_;
+	const unsigned baud_;
+	std::function<bool(const std::vector<Symbol>&)> lose_;
+
+	// CPU.
+	uint8_t data_[RAMEND + 1];								//Registers, I/O and SRAM.
+	uint32_t pc_ = 0;										//Word address.
+	uint64_t cycles_ = 0;
+	bool halted_ = false;
+
+	// Self-programming.
+	std::vector<uint8_t> pageBuf_;
+	uint64_t spmUntil_ = 0;									//SPM command window (4 cycles).
+	uint64_t spmBusy_ = 0;									//Page erase/write done.
+	bool rwwBusy_ = false;
+
+	// Watchdog.
+	uint64_t wdceUntil_ = 0;								//Timed sequence window (4 cycles).
+	uint64_t wdtStart_ = 0;
+
+	// USART0.
+	struct Rx {
+		Symbol sym;
+		bool fe;
+	};
+	std::deque<Symbol> wire_;								//Bytes on their way to the receiver.
+	std::vector<Symbol> inFrame_;							//Frame from the Master being collected.
+	std::deque<Rx> rxFifo_;									//Receive buffer (2 bytes).
+	bool dor_ = false;
+	uint64_t rxNext_ = 0;
+	Symbol txBuf_{0, false};
+	bool txFull_ = false;
+	Symbol txShift_{0, false};
+	bool txBusy_ = false;
+	uint64_t txDone_ = 0;
+	bool txc_ = false;
+	std::vector<Symbol> outFrame_;							//Bytes sent while transmitting.
+
+	std::thread thread_;
+	std::atomic<bool> stop_{false};
+	std::atomic<unsigned> resets_{0};
+	std::atomic<bool> appStarted_{false};
+	mutable std::mutex errorMutex_;
+	std::string error_;
+
+	void reset(Reset reset);
+	void run();
+	void fail(const std::string& what);
+	void receiveBus();
+	void peripherals();
+	uint32_t step();
+
+	uint8_t read(uint16_t addr);
+	void write(uint16_t addr, uint8_t value);
+	uint8_t& reg(unsigned r) { return data_[r]; }
+	uint16_t word(unsigned r) const { return static_cast<uint16_t>(data_[r] | data_[r + 1] << 8); }
+	void setWord(unsigned r, uint16_t value);
+	uint16_t fetch(uint32_t pc) const;
+	uint8_t lpm(uint32_t addr);
+	void spm();
+	void push(uint8_t value);
+	uint8_t pop();
+	bool flag(unsigned bit) const { return (data_[0x5F] >> bit) & 1; }
+	void setFlag(unsigned bit, bool on);
+	uint32_t byteCycles() const;
+	bool formatOk() const;
+	bool transmitting() const;
+};
+
+} // namespace rs485
+
+#endif
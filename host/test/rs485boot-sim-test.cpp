@@ -0,0 +1,231 @@
+/*==================================================================================================*
+ *SYNOPSIS:
+ *	Test of the rs485boot bootloader itself: the image assembled from src/rs485boot/rs485boot.S
+ *	for the ATmega328P (Intel HEX, argument 1) runs on the instruction set simulator (avrsim.h)
+ *	and is updated by BootLoader over a pty pair. Covers the reset window, the watchdog, a full
+ *	update with a lost DATA message and an update that is cut short. Returns 0 if all checks pass.
+ *
+ *	The image must be built with F_CPU=16000000, BAUD=38400 and RS485BOOT_TIMEOUT=200, linked at
+ *	0x7800 (RS485BOOT_SIZE 2048).
+ *==================================================================================================*/
+#include "avrsim.h"
+
+#include <rs485/boot.h>
+#include <rs485/frame.h>
+#include <rs485/master.h>
+#include <rs485/transport.h>
+
+#include <algorithm>
+#include <cstdio>
+#include <fstream>
+#include <memory>
+#include <thread>
+
+using namespace rs485;
+using namespace std::chrono_literals;
+
+static int failures = 0;
+
+#define CHECK(cond)															\
+	do {																	\
+		if (!(cond)) {														\
+			std::fprintf(stderr, "%s:%d: CHECK(%s) failed\n", __FILE__, __LINE__, #cond);	\
+			++failures;														\
+		}																	\
+	} while (0)
+
+static constexpr uint32_t F_CPU = 16000000;
+static constexpr uint32_t BOOT_START = 0x7800;
+static constexpr auto WINDOW = 200ms;						//RS485BOOT_TIMEOUT of the image.
+static constexpr uint8_t SLAVE_ADDRESS = 5;
+static constexpr uint8_t OTHER_SLAVE = 7;
+static constexpr uint16_t PAGE_SIZE = AvrSim::PAGE_SIZE;
+
+// Master side of the bus that takes the bus time of the bytes sent, like a serial port drained
+// after each message (SerialTransport), so the simulated Slave gets them at the bus pace.
+class PacedTransport : public Transport {
+public:
+	explicit PacedTransport(Transport& bus) : bus_(bus) {}
+
+	void send(const std::vector<uint8_t>& frame) override
+	{
+		bus_.send(frame);
+		std::this_thread::sleep_for(bus_.byteTime() * static_cast<long>(frame.size()));
+	}
+	RxStatus receive(Symbol& sym, std::chrono::microseconds timeout) override
+	{
+		return bus_.receive(sym, timeout);
+	}
+	void flush() override { bus_.flush(); }
+	std::chrono::microseconds byteTime() const override { return bus_.byteTime(); }
+
+private:
+	Transport& bus_;
+};
+
+// Application image of the given pages: a pattern, with page 3 (if any) erased.
+static std::vector<uint8_t> application(uint16_t pages, uint8_t seed)
+{
+	std::vector<uint8_t> image(static_cast<std::size_t>(pages) * PAGE_SIZE);
+	for (std::size_t i = 0; i < image.size(); ++i)
+		image[i] = static_cast<uint8_t>(i * 7 + seed);
+	if (pages > 3)
+		std::fill(image.begin() + 3 * PAGE_SIZE, image.begin() + 4 * PAGE_SIZE, 0xFF);
+	return image;
+}
+
+static bool flashHas(const AvrSim& sim, const std::vector<uint8_t>& image)
+{
+	return std::equal(image.begin(), image.end(), sim.flash.begin());
+}
+
+// Program the bootloader and an application, and our Slave address in the last EEPROM byte.
+static void program(AvrSim& sim, const std::vector<uint8_t>& boot, const std::vector<uint8_t>& app)
+{
+	std::fill(sim.flash.begin(), sim.flash.end(), 0xFF);
+	std::copy(boot.begin() + BOOT_START, boot.end(), sim.flash.begin() + BOOT_START);
+	std::copy(app.begin(), app.end(), sim.flash.begin());
+	sim.eeprom.back() = SLAVE_ADDRESS;
+}
+
+// The page times leave room for the simulator thread waiting for the CPU on a loaded host; a
+// page lost anyway is sent again, so the tests check the pages resent as a minimum.
+static BootOptions bootOptions()
+{
+	BootOptions options;
+	options.responseTimeout = 100ms;
+	options.enterRepeat = 3;
+	options.enterInterval = 20ms;
+	options.pageWrite = 20ms;
+	options.pageErase = 10ms;
+	return options;
+}
+
+// Without bootloader Commands the application starts after the reset window, counted from reset:
+// messages for other Slaves don't extend it.
+static void test_window(const std::vector<uint8_t>& boot)
+{
+	std::unique_ptr<StreamTransport> a, b;
+	StreamTransport::openPair(a, b);
+	PacedTransport bus(*a);
+	AvrSim sim(*b, F_CPU, BOOT_START);
+	program(sim, boot, application(4, 1));
+	Master master(bus, MasterOptions{10ms, 0, false, 0us});
+	auto start = std::chrono::steady_clock::now();
+	sim.start();
+	bool early = false;
+	while (!sim.appStarted() && std::chrono::steady_clock::now() - start < 3 * WINDOW) {
+		master.send(OTHER_SLAVE, 0x31, {1, 2, 3});
+		early = early || (sim.appStarted() && std::chrono::steady_clock::now() - start < WINDOW / 2);
+		std::this_thread::sleep_for(10ms);
+	}
+	auto took = std::chrono::steady_clock::now() - start;
+	CHECK(sim.appStarted());
+	CHECK(!early);
+	CHECK(took < 2 * WINDOW);
+	CHECK(sim.error().empty());
+	if (!sim.error().empty())
+		std::fprintf(stderr, "simulator: %s\n", sim.error().c_str());
+}
+
+// Update after a watchdog reset (the bootloader must stop the watchdog), losing the first DATA
+// message of page 2: page 2 is sent again, and page 0 after it.
+static void test_update(const std::vector<uint8_t>& boot)
+{
+	std::unique_ptr<StreamTransport> a, b;
+	StreamTransport::openPair(a, b);
+	PacedTransport bus(*a);
+	AvrSim sim(*b, F_CPU, BOOT_START);
+	program(sim, boot, application(8, 1));
+	bool lost = false;
+	sim.setLoss([&lost](const std::vector<Symbol>& frame) {
+		if (lost || frame.size() < 5 || frame[1].data != BOOT_DATA || frame[3].data != 2 || frame[4].data != 0)
+			return false;
+		return lost = true;
+	});
+	sim.start(AvrSim::Reset::Watchdog);
+	std::vector<uint8_t> image = application(6, 2);
+	BootLoader loader(bus, bootOptions());
+	std::size_t progress = 0;
+	std::vector<BootResult> results = loader.update(image, {SLAVE_ADDRESS, 9},
+		std::array<uint8_t, 3>{0x1E, 0x95, 0x0F}, [&progress](std::size_t done, std::size_t) { progress = done; });
+	std::this_thread::sleep_for(20ms);
+	sim.stop();
+	CHECK(progress == 6);
+	CHECK(results.size() == 2);
+	CHECK(results[0].ok && results[0].rewrites >= 2);
+	CHECK(!results[1].ok && results[1].error == "no response");
+	CHECK(lost);
+	CHECK(flashHas(sim, image));
+	CHECK(sim.appStarted());
+	CHECK(sim.resets() == 1);									//The watchdog was stopped.
+	CHECK(sim.error().empty());
+	if (!sim.error().empty())
+		std::fprintf(stderr, "simulator: %s\n", sim.error().c_str());
+}
+
+// An update cut short after two pages leaves no reset vector: after the next reset the Slave stays
+// in the bootloader, and the next update succeeds.
+static void test_cut_short(const std::vector<uint8_t>& boot)
+{
+	std::unique_ptr<StreamTransport> a, b;
+	StreamTransport::openPair(a, b);
+	PacedTransport bus(*a);
+	AvrSim sim(*b, F_CPU, BOOT_START);
+	program(sim, boot, application(6, 1));
+	sim.start();
+	std::vector<uint8_t> image = application(6, 2);
+	BootLoader loader(bus, bootOptions());
+	struct Cut {};
+	bool cut = false;
+	try {
+		loader.update(image, {SLAVE_ADDRESS}, std::nullopt, [](std::size_t done, std::size_t) {
+			if (done == 2)
+				throw Cut();
+		});
+	} catch (const Cut&) {
+		cut = true;
+	}
+	std::this_thread::sleep_for(20ms);
+	sim.stop();
+	CHECK(cut);
+	CHECK(sim.flash[0] == 0xFF && sim.flash[1] == 0xFF);		//Reset vector erased.
+	CHECK(std::equal(image.begin() + PAGE_SIZE, image.begin() + 3 * PAGE_SIZE, sim.flash.begin() + PAGE_SIZE));
+
+	// Power cycle: no application to start.
+	sim.start();
+	std::this_thread::sleep_for(2 * WINDOW);
+	CHECK(!sim.appStarted());
+
+	std::vector<BootResult> results = loader.update(image, {SLAVE_ADDRESS});
+	std::this_thread::sleep_for(20ms);
+	sim.stop();
+	CHECK(results.size() == 1 && results[0].ok);
+	CHECK(flashHas(sim, image));
+	CHECK(sim.appStarted());
+	CHECK(sim.error().empty());
+	if (!sim.error().empty())
+		std::fprintf(stderr, "simulator: %s\n", sim.error().c_str());
+}
+
+int main(int argc, char** argv)
+{
+	if (argc != 2) {
+		std::fprintf(stderr, "usage: rs485boot-sim-test rs485boot.hex\n");
+		return 2;
+	}
+	std::ifstream in(argv[1]);
+	std::vector<uint8_t> boot = readIntelHex(in);
+	if (boot.size() <= BOOT_START || boot.size() > AvrSim::FLASH_SIZE) {
+		std::fprintf(stderr, "%s: no bootloader at 0x%X\n", argv[1], static_cast<unsigned>(BOOT_START));
+		return 2;
+	}
+	test_window(boot);
+	test_update(boot);
+	test_cut_short(boot);
+	if (failures)
+		std::fprintf(stderr, "%d check(s) failed\n", failures);
+	else
+		std::printf("rs485boot-sim-test: all checks passed\n");
+	return failures ? 1 : 0;
+}
@@ -0,0 +1,339 @@
+/*==================================================================================================*
+ *SYNOPSIS:
+ *	Test of the rs485 host library: a Master and a Slave talking over a pty pair, as a stand-in
+ *	for the bus. Returns 0 if all checks pass.
+ *==================================================================================================*/
+#include <rs485/boot.h>
+#include <rs485/frame.h>
+#include <rs485/master.h>
+#include <rs485/slave.h>
+#include <rs485/transport.h>
+
+#include <atomic>
+#include <cstdio>
+#include <memory>
+#include <sstream>
+#include <thread>
+
+using namespace rs485;
+using namespace std::chrono_literals;
+
+static int failures = 0;
+
+#define CHECK(cond)															\
+	do {																	\
+		if (!(cond)) {														\
+			std::fprintf(stderr, "%s:%d: CHECK(%s) failed\n", __FILE__, __LINE__, #cond);	\
+			++failures;														\
+		}																	\
+	} while (0)
+
+static constexpr uint8_t SLAVE_ADDRESS = 5;
+static constexpr uint8_t GROUP_ADDRESS = 100;
+static constexpr uint8_t CMD_ECHO = 0x31;					//Response: the parameters reversed.
+static constexpr uint8_t CMD_COUNT = 0x32;					//Response: number of calls so far.
+
+// Slave serving on its end of the pty pair until stopped.
+class SlaveThread {
+public:
+	SlaveThread(Transport& bus, bool sequenceNumbers)
+		: slave_(bus, SLAVE_ADDRESS, {sequenceNumbers, {GROUP_ADDRESS}, 0us})
+	{
+		slave_.on(CMD_ECHO, [](const Message& req, Message& resp) {
+			resp.params.assign(req.params.rbegin(), req.params.rend());
+		});
+		slave_.on(CMD_COUNT, [this](const Message&, Message& resp) {
+			resp.params.push_back(static_cast<uint8_t>(++calls));
+		});
+		thread_ = std::thread([this] {
+			while (!stop_)
+				slave_.serve(5ms);
+		});
+	}
+	~SlaveThread()
+	{
+		stop_ = true;
+		thread_.join();
+	}
+
+	std::atomic<int> calls{0};
+
+private:
+	Slave slave_;
+	std::atomic<bool> stop_{false};
+	std::thread thread_;
+};
+
+// rs485boot Slave on a simulated flash, losing the first RS485BOOT_DATA message of one page. Like
+// the bootloader, the first page written other than page 0 erases page 0 (the reset vector).
+class BootThread {
+public:
+	static constexpr uint16_t PAGE_SIZE = 64;
+	static constexpr uint16_t PAGES = 16;
+	static constexpr uint16_t LOST_PAGE = 2;
+
+	explicit BootThread(Transport& bus)
+		: flash(PAGE_SIZE * PAGES, 0x00), slave_(bus, SLAVE_ADDRESS)
+	{
+		slave_.on(BOOT_ENTER, [this](const Message&, Message& resp) {
+			failed_ = 0;
+			firstFailed_ = 0xFFFF;
+			resp.params = {PAGE_SIZE & 0xFF, PAGE_SIZE >> 8, 0x1E, 0x95, 0x0F, 1, PAGES & 0xFF, PAGES >> 8};
+		});
+		slave_.on(BOOT_DATA, [this](const Message& req, Message&) {
+			uint16_t page = static_cast<uint16_t>(req.params[0] | req.params[1] << 8);
+			if (page == LOST_PAGE && !lost_) {
+				lost_ = true;
+				return;
+			}
+			if (page != page_) {
+				page_ = page;
+				buffer_.assign(PAGE_SIZE, 0xFF);
+			}
+			std::copy(req.params.begin() + 3, req.params.end(), buffer_.begin() + req.params[2]);
+		});
+		slave_.on(BOOT_WRITE, [this](const Message& req, Message& resp) {
+			uint16_t page = static_cast<uint16_t>(req.params[0] | req.params[1] << 8);
+			uint16_t crc = static_cast<uint16_t>(req.params[2] | req.params[3] << 8);
+			BootStatus status = BootStatus::Ok;
+			if (page != page_ || crc16(buffer_.data(), buffer_.size()) != crc) {
+				status = BootStatus::BadData;
+			} else {
+				if (page != 0 && (flash[0] != 0xFF || flash[1] != 0xFF))
+					std::fill(flash.begin(), flash.begin() + PAGE_SIZE, 0xFF);
+				std::copy(buffer_.begin(), buffer_.end(), flash.begin() + page * PAGE_SIZE);
+				lastPage = page;
+			}
+			if (status != BootStatus::Ok && failed_++ == 0)
+				firstFailed_ = page;
+			resp.params = {static_cast<uint8_t>(status)};
+		});
+		slave_.on(BOOT_VERIFY, [this](const Message& req, Message& resp) {
+			std::size_t first = req.params[0] | req.params[1] << 8;
+			std::size_t count = req.params[2] | req.params[3] << 8;
+			uint16_t crc = crc16(flash.data() + first * PAGE_SIZE, count * PAGE_SIZE);
+			resp.params = {failed_, static_cast<uint8_t>(firstFailed_), static_cast<uint8_t>(firstFailed_ >> 8),
+				static_cast<uint8_t>(crc), static_cast<uint8_t>(crc >> 8)};
+		});
+		slave_.on(BOOT_EXIT, [this](const Message&, Message&) { exited = true; });
+		thread_ = std::thread([this] {
+			while (!stop_)
+				slave_.serve(5ms);
+		});
+	}
+	~BootThread()
+	{
+		stop_ = true;
+		thread_.join();
+	}
+
+	std::vector<uint8_t> flash;
+	std::atomic<uint16_t> lastPage{0xFFFF};				//Page written last.
+	std::atomic<bool> exited{false};
+
+private:
+	Slave slave_;
+	std::vector<uint8_t> buffer_;
+	uint16_t page_ = 0xFFFF;
+	uint8_t failed_ = 0;
+	uint16_t firstFailed_ = 0xFFFF;
+	bool lost_ = false;
+	std::atomic<bool> stop_{false};
+	std::thread thread_;
+};
+
+static void test_frame()
+{
+	const uint8_t check[] = {'1', '2', '3', '4', '5', '6', '7', '8', '9'};
+	CHECK(crc16(check, sizeof check) == 0x29B1);				//CRC-16/CCITT check value.
+
+	Message msg;
+	msg.addr = SLAVE_ADDRESS | RESPONSE_EXPECTED;
+	msg.cmd = CMD_ECHO;
+	msg.seq = 3;
+	msg.params = {0x00, 0xFF, 0x55};
+	std::vector<uint8_t> frame = encode(msg);
+	CHECK(frame.size() == 8);
+	CHECK(frame[2] == 0x33);									//Sequence number in bits 7-4.
+	uint16_t crc = crc16(frame.data(), 6);
+	CHECK(frame[6] == (crc & 0xFF) && frame[7] == (crc >> 8));	//Low byte first.
+
+	FrameDecoder decoder(true);
+	bool done = false;
+	for (std::size_t i = 0; i < frame.size(); ++i)
+		done = decoder.feed({frame[i], i == 0});
+	CHECK(done);
+	CHECK(decoder.message().addr == msg.addr && decoder.message().seq == 3 && decoder.message().params == msg.params);
+
+	frame[4] ^= 1;												//Corrupt a parameter.
+	done = false;
+	for (std::size_t i = 0; i < frame.size(); ++i)
+		done = decoder.feed({frame[i], i == 0});
+	CHECK(!done && decoder.stats().crc == 1);
+
+	std::vector<uint8_t> params = batch_encode({{1, {2, 3}}, {4, {}}});
+	CHECK(params == (std::vector<uint8_t>{1, 2, 2, 3, 4, 0}));
+	std::vector<BatchItem> items = batch_decode(params);
+	CHECK(items.size() == 2 && items[0].cmd == 1 && items[0].params.size() == 2 && items[1].cmd == 4);
+}
+
+static void test_poll()
+{
+	std::unique_ptr<StreamTransport> a, b;
+	StreamTransport::openPair(a, b);
+	SlaveThread slave(*b, false);
+	MasterOptions options;
+	options.responseTimeout = 20ms;
+	Master master(*a, options);
+
+	auto resp = master.request(SLAVE_ADDRESS, CMD_ECHO, {1, 0xFF, 3});
+	CHECK(resp && resp->slave() == SLAVE_ADDRESS && resp->cmd == CMD_ECHO);
+	CHECK(resp && resp->params == (std::vector<uint8_t>{3, 0xFF, 1}));
+
+	// Batch over slaves 1-8: only slave 5 answers, the others go offline after the retries.
+	std::vector<PollRequest> batch;
+	for (uint8_t addr = 1; addr <= 8; ++addr)
+		batch.push_back({addr, CMD_ECHO, {addr}});
+	std::vector<PollResult> results = master.pollBatch(batch);
+	CHECK(results.size() == 8);
+	for (const PollResult& r : results) {
+		if (r.slave == SLAVE_ADDRESS) {
+			CHECK(r.status == PollStatus::Ok && r.attempts == 1 && r.response.params.size() == 1);
+		} else {
+			CHECK(r.status == PollStatus::Offline && r.attempts == options.retries + 1);
+			CHECK(!master.online(r.slave));
+		}
+	}
+
+	// Asynchronous: offline slaves are polled once, results come in as they are done.
+	std::atomic<int> seen{0};
+	auto pending = master.pollAsync(batch, [&seen](const PollResult&) { ++seen; });
+	results = pending.get();
+	CHECK(seen == 8);
+	for (const PollResult& r : results)
+		CHECK(r.slave == SLAVE_ADDRESS ? r.status == PollStatus::Ok : r.attempts == 1);
+
+	// Broadcast and group messages are handled without a Response.
+	master.broadcast(CMD_COUNT);
+	master.send(GROUP_ADDRESS, CMD_COUNT);
+	std::this_thread::sleep_for(50ms);
+	CHECK(slave.calls == 2);
+	CHECK(master.stats().rx == 3);								//Request and 2 batches, none for the others.
+}
+
+static void test_cache()
+{
+	std::unique_ptr<StreamTransport> a, b;
+	StreamTransport::openPair(a, b);
+	SlaveThread slave(*b, true);
+
+	// Same Request (same sequence number) twice, as a Master does after a lost Response.
+	Message req;
+	req.addr = SLAVE_ADDRESS | RESPONSE_EXPECTED;
+	req.cmd = CMD_COUNT;
+	req.seq = 7;
+	FrameDecoder decoder(true);
+	for (int i = 0; i < 2; ++i) {
+		a->send(encode(req));
+		bool done = false;
+		Symbol sym;
+		while (!done && a->receive(sym, 200ms) == RxStatus::Ok)
+			done = decoder.feed(sym);
+		CHECK(done);
+		CHECK(decoder.message().seq == 7 && decoder.message().params == std::vector<uint8_t>{1});
+	}
+	CHECK(slave.calls == 1);									//Retry answered from the cache.
+
+	// The Master gives each new poll the next sequence number.
+	MasterOptions options;
+	options.responseTimeout = 20ms;
+	options.sequenceNumbers = true;
+	Master master(*a, options);
+	auto first = master.request(SLAVE_ADDRESS, CMD_COUNT);
+	auto second = master.request(SLAVE_ADDRESS, CMD_COUNT);
+	CHECK(first && second && first->seq == 1 && second->seq == 2);
+	CHECK(second && second->params == std::vector<uint8_t>{3});
+
+	// A late Response of an earlier poll (older sequence number) is dropped, not taken as the
+	// Response of the current poll.
+	std::unique_ptr<StreamTransport> c, d;
+	StreamTransport::openPair(c, d);
+	Master late(*c, options);
+	std::thread responder([&d] {
+		FrameDecoder requests(true);
+		bool done = false;
+		Symbol sym;
+		while (!done && d->receive(sym, 500ms) == RxStatus::Ok)
+			done = requests.feed(sym);
+		Message resp;
+		resp.addr = SLAVE_ADDRESS;
+		resp.cmd = requests.message().cmd;
+		resp.seq = 15;											//Poll before sequence number 1.
+		resp.params = {0xEE};
+		d->send(encode(resp));
+		resp.seq = requests.message().seq;
+		resp.params = {0x01};
+		d->send(encode(resp));
+	});
+	auto fresh = late.request(SLAVE_ADDRESS, CMD_COUNT);
+	responder.join();
+	CHECK(fresh && fresh->seq == 1 && fresh->params == std::vector<uint8_t>{1});
+}
+
+static void test_boot()
+{
+	std::istringstream hex(
+		":0400000001020304F2\n"
+		":020000040000FA\n"
+		":02004000AA55BF\n"
+		":00000001FF\n");
+	std::vector<uint8_t> small = readIntelHex(hex);
+	CHECK(small.size() == 0x42 && small[0] == 1 && small[3] == 4 && small[4] == 0xFF && small[0x41] == 0x55);
+	std::istringstream broken(":0400000001020304F3\n");
+	bool thrown = false;
+	try {
+		readIntelHex(broken);
+	} catch (const std::runtime_error&) {
+		thrown = true;
+	}
+	CHECK(thrown);												//Wrong checksum.
+
+	// Image of 5 pages with an erased page 3; page 2 needs a second try, and page 0 with it.
+	std::vector<uint8_t> image(BootThread::PAGE_SIZE * 5);
+	for (std::size_t i = 0; i < image.size(); ++i)
+		image[i] = static_cast<uint8_t>(i * 7);
+	std::fill(image.begin() + 3 * BootThread::PAGE_SIZE, image.begin() + 4 * BootThread::PAGE_SIZE, 0xFF);
+
+	std::unique_ptr<StreamTransport> a, b;
+	StreamTransport::openPair(a, b);
+	BootThread node(*b);
+	BootOptions options;
+	options.responseTimeout = 50ms;
+	options.enterRepeat = 2;
+	options.enterInterval = 5ms;
+	options.pageWrite = 1ms;
+	BootLoader boot(*a, options);
+	std::size_t progress = 0;
+	std::vector<BootResult> results = boot.update(image, {SLAVE_ADDRESS, 9}, std::array<uint8_t, 3>{0x1E, 0x95, 0x0F},
+		[&progress](std::size_t done, std::size_t) { progress = done; });
+	CHECK(progress == 5);
+	CHECK(results.size() == 2);
+	CHECK(results[0].ok && results[0].rewrites == 2);
+	CHECK(!results[1].ok && results[1].error == "no response");
+	CHECK(std::equal(image.begin(), image.end(), node.flash.begin()));
+	CHECK(node.lastPage == 0);
+	CHECK(node.exited);
+}
+
+int main()
+{
+	test_frame();
+	test_poll();
+	test_cache();
+	test_boot();
+	if (failures)
+		std::fprintf(stderr, "%d check(s) failed\n", failures);
+	else
+		std::printf("rs485host-test: all checks passed\n");
+	return failures ? 1 : 0;
+}
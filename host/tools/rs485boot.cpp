@@ -0,0 +1,93 @@
+/*==================================================================================================*
+ *SYNOPSIS:
+ *	Firmware update of rs485boot Slaves from the command line:
+ *
+ *	rs485boot [-b baud] [-e] [-s signature] device image.hex slave...
+ *
+ *	-b	Baud rate of the bus (default 38400).
+ *	-e	The RS485 adapter echoes the bytes sent.
+ *	-s	Device signature the Slaves must have, as 6 hex digits (e.g. 1e950f for the ATmega328P).
+ *
+ *	The Slaves (addresses 1-127) are expected to enter the bootloader after a reset (reset window)
+ *	or on a Command of their application. Returns 0 if all Slaves were updated.
+ *==================================================================================================*/
+#include <rs485/boot.h>
+#include <rs485/transport.h>
+
+#include <cstdio>
+#include <cstdlib>
+#include <exception>
+#include <fstream>
+#include <unistd.h>
+
+using namespace rs485;
+
+static int usage()
+{
+	std::fprintf(stderr, "usage: rs485boot [-b baud] [-e] [-s signature] device image.hex slave...\n");
+	return 2;
+}
+
+int main(int argc, char* argv[])
+{
+	unsigned baud = 38400;
+	bool echo = false;
+	std::optional<std::array<uint8_t, 3>> signature;
+	int opt;
+	while ((opt = getopt(argc, argv, "b:es:")) != -1) {
+		switch (opt) {
+		case 'b':
+			baud = static_cast<unsigned>(std::strtoul(optarg, nullptr, 10));
+			break;
+		case 'e':
+			echo = true;
+			break;
+		case 's': {
+			unsigned long sig = std::strtoul(optarg, nullptr, 16);
+			signature = {static_cast<uint8_t>(sig >> 16), static_cast<uint8_t>(sig >> 8), static_cast<uint8_t>(sig)};
+			break;
+		}
+		default:
+			return usage();
+		}
+	}
+	if (argc - optind < 3)
+		return usage();
+	std::vector<uint8_t> slaves;
+	for (int i = optind + 2; i < argc; ++i) {
+		long addr = std::strtol(argv[i], nullptr, 0);
+		if (addr < 1 || addr > 127)
+			return usage();
+		slaves.push_back(static_cast<uint8_t>(addr));
+	}
+
+	try {
+		std::ifstream file(argv[optind + 1]);
+		if (!file) {
+			std::fprintf(stderr, "rs485boot: can't open %s\n", argv[optind + 1]);
+			return 1;
+		}
+		std::vector<uint8_t> image = readIntelHex(file);
+		SerialTransport bus(argv[optind], baud, echo);
+		BootLoader boot(bus);
+		std::vector<BootResult> results = boot.update(image, slaves, signature,
+			[](std::size_t done, std::size_t total) {
+				std::fprintf(stderr, "\rpage %zu/%zu", done, total);
+				if (done == total)
+					std::fprintf(stderr, "\n");
+			});
+		int failed = 0;
+		for (const BootResult& r : results) {
+			if (r.ok) {
+				std::printf("slave %u: ok (%u page(s) sent again)\n", r.slave, r.rewrites);
+			} else {
+				std::printf("slave %u: %s\n", r.slave, r.error.c_str());
+				++failed;
+			}
+		}
+		return failed ? 1 : 0;
+	} catch (const std::exception& e) {
+		std::fprintf(stderr, "rs485boot: %s\n", e.what());
+		return 1;
+	}
+}
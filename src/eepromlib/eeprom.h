@@ -4,6 +4,16 @@
 ;*	AVR MCUs.																						*;
 ;*																									*;
 ;*VERSION HISTORY:																					*;
+;*	20261018 v0.10	Callback no longer called twice when a read races the EE_RDY interrupt;			*;
+;*					ee_sync restores the sleep mode.												*;
+;*	20261018 v0.9	Added EEPROM key-value store.													*;
+;*	20261018 v0.8	Added non-blocking write, ee_busy/ee_sync and completion callback.				*;
+;*	20261018 v0.7	Added atomic CRC protected EEPROM records.										*;
+;*	20261018 v0.6	Added ATtiny25/45/85 and ATmega48/88/168/328 support; fixed buffer handling		*;
+;*					for devices with more than 256 bytes of EEPROM.									*;
+;*	20261018 v0.5	Added optional SRAM shadow cache for an EEPROM address range.					*;
+;*	20261018 v0.4	Added wear-leveled EEPROM variables.											*;
+;*	20261018 v0.3	Added block read/write routines.												*;
 ;*	20141031 v0.1	Initial test version.															*;
 ;*																									*;
 ;*DESCRIPTION:																						*;
@@ -15,6 +25,8 @@
 ;*		calling program.																			*;
 ;*	2.	Don't use 1st byte of EEPROM as it may get corrupted during power down.						*;
 ;*	3.	Writing or Erasing takes about 1.8ms on an ATtiny (Erase+Write 3.6ms).						*;
+;*	4.	With EE_CACHE_START/EE_CACHE_SIZE defined in the makefile, the EEPROM bytes in that range	*;
+;*		are shadowed in SRAM (ee_cache) and ee_readbyte reads them without waiting for the EEPROM.	*;
 ;*																									*;
 ;*COPYRIGHT:																						*;
 ;*	(c)2014 by Ron Moerman, All Rights Reserved.													*;
@@ -25,11 +37,11 @@
 ;*	See http://www.gnu.org/licenses/gpl-3.0.txt for details.										*;
 ;*																									*;
 ;*	$File: eeprom.h $																				*;
-;*	$Revision: 0.1 $																				*;
+;*	$Revision: 0.10 $																				*;
 ;*	$ASM: AVR-GCC AS $																				*;
 ;*	$Author: Ron Moerman $																			*;
 ;*	$Email: ron@moerman.cc $																		*;
-;*	$Date: Thursday, October 31, 2014 19:21:24 UTC $												*;
+;*	$Date: Sunday, October 18, 2026 18:12:30 UTC $													*;
 ;*==================================================================================================*/
 
 #ifndef ___EEPROM_H___
@@ -40,6 +52,29 @@
 ;*                                         C O N S T A N T S                                        *;
 ;*==================================================================================================*/
 
+; Structure of the wear-leveled variable descriptor (in SRAM, set up by the application).
+EEWL_ADDR = 0											;EEPROM address of the slot ring (2 bytes).
+EEWL_SLOTS = 2											;Number of slots in the ring (2-254).
+EEWL_SIZE = 3											;Number of value bytes per slot (1-254).
+EEWL_CUR = 4											;Current slot (set by ee_wl_init/ee_wl_write).
+EEWL_SEQ = 5											;Sequence marker of the current slot.
+EEWL_DESC_SIZE = 6										;Total length of the descriptor.
+; A ring takes EEWL_SLOTS*(EEWL_SIZE+1) bytes of EEPROM.
+EEWL_NONE = 0xFF										;EEWL_CUR value when no slot is written yet.
+
+; Structure of the atomic record descriptor (in SRAM, set up by the application).
+EEREC_ADDR = 0											;EEPROM address of the first record slot (2 bytes).
+EEREC_SIZE = 2											;Number of record data bytes (1-252).
+EEREC_CUR = 3											;Valid slot (set by ee_rec_init/ee_rec_write).
+EEREC_GEN = 4											;Generation marker of the valid slot.
+EEREC_DESC_SIZE = 5										;Total length of the descriptor.
+; A record takes 2*(EEREC_SIZE+3) bytes of EEPROM: per slot the data, CRC16 (LO:HI) and generation.
+EEREC_NONE = 0xFF										;EEREC_CUR value when there is no valid record.
+
+; SRAM shadow copy of EEPROM bytes EE_CACHE_START..EE_CACHE_START+EE_CACHE_SIZE-1 (read only).
+#ifndef ___EEPROM_LIB___
+		.extern	ee_cache
+#endif
 
 
 /*==================================================================================================*;
@@ -52,6 +87,8 @@
 ;*DESCRIPTION:																						*;
 ;*	This function writes 0xFF in all EEPROM Address and Data buffer locations to indicate empty		*;
 ;*	slots. Set the initflag to indicate it is initialized.											*;
+;*	The library routines do this on first use; call ee_init at startup to take this (and loading	*;
+;*	the EEPROM cache, if any) out of the first EEPROM access.										*;
 ;*																									*;
 ;*INPUT:																							*;
 ;*	None.																							*;
@@ -60,10 +97,10 @@
 ;*	None.																							*;
 ;*																									*;
 ;*REGISTER USAGE:																					*;
-;*	YL (YH if SRAM>256 bytes).																		*;
+;*	None.																							*;
 ;*																									*;
 ;*LOCAL STACK USAGE:																				*;
-;*	? bytes, including calling this routine.														*;
+;*	7-8 bytes, including calling this routine.														*;
 ;*																									*;
 ;*NOTES:																							*;
 ;*	1.	This routine consumes XX MCU cycles, including returning to the calling program.			*;
@@ -92,7 +129,7 @@
 ;*	R24.																							*;
 ;*																									*;
 ;*LOCAL STACK USAGE:																				*;
-;*	6 bytes, including calling this routine.														*;
+;*	7-8 bytes, including calling this routine.														*;
 ;*																									*;
 ;*NOTES:																							*;
 ;*	1.	This routine consumes XX cpu cycles, including returning to the calling program.			*;
@@ -126,10 +163,12 @@
 ;*	None.																							*;
 ;*																									*;
 ;*LOCAL STACK USAGE:																				*;
-;*	7-8 bytes, including calling this routine.														*;
+;*	9-10 bytes, including calling this routine.														*;
 ;*																									*;
 ;*NOTES:																							*;
 ;*	1.	This routine consumes XX cpu cycles, including returning to the calling program.			*;
+;*	2.	If the buffer is full, this routine waits until the EE_RDY interrupt frees a slot; use		*;
+;*		ee_trywritebyte to avoid waiting.															*;
 ;*--------------------------------------------------------------------------------------------------*/
 #ifndef ___EEPROM_LIB___
 		.extern	ee_writebyte
@@ -137,6 +176,508 @@
 		.global ee_writebyte
 #endif
 
+
+/*--------------------------------------------------------------------------------------------------*;
+;* ee_trywritebyte: Write a byte to EEPROM if there is room in the buffer.							*;
+;*--------------------------------------------------------------------------------------------------*;
+;*DESCRIPTION:																						*;
+;*	This function does the same as ee_writebyte, but never waits: if the address is not in the		*;
+;*	buffer yet and the buffer is full, it returns with CF=1 and nothing is written. The caller can	*;
+;*	do other work and try again later.																*;
+;*																									*;
+;*INPUT:																							*;
+;*	X(L) = EEPROM address to write.																	*;
+;*	R24 = Byte to write in EEPROM.																	*;
+;*																									*;
+;*OUTPUT:																							*;
+;*	CF=0: Byte put in the buffer;																	*;
+;*	CF=1: Buffer full, byte not written.															*;
+;*																									*;
+;*REGISTER USAGE:																					*;
+;*	None.																							*;
+;*																									*;
+;*LOCAL STACK USAGE:																				*;
+;*	7-8 bytes, including calling this routine.														*;
+;*																									*;
+;*NOTES:																							*;
+;*	1.	This routine consumes ~35 MCU cycles plus 7-9 cycles per occupied buffer slot searched,		*;
+;*		including returning to the calling program.													*;
+;*--------------------------------------------------------------------------------------------------*/
+#ifndef ___EEPROM_LIB___
+		.extern	ee_trywritebyte
+#else
+		.global ee_trywritebyte
+#endif
+
+
+/*--------------------------------------------------------------------------------------------------*;
+;* ee_read_block: Read a block of bytes from EEPROM into SRAM.										*;
+;*--------------------------------------------------------------------------------------------------*;
+;*DESCRIPTION:																						*;
+;*	This function reads a block of bytes from EEPROM, starting at the specified EEPROM location,	*;
+;*	into SRAM. The bytes are streamed straight from the EEPROM Data Register once any programming	*;
+;*	in progress has finished; bytes still waiting in the EEPROM buffer are patched in afterwards,	*;
+;*	so the caller always sees the most recent data.													*;
+;*																									*;
+;*INPUT:																							*;
+;*	X(L) = EEPROM start address to read;															*;
+;*	Z = SRAM address to store the data bytes;														*;
+;*	R24 = Number of bytes to read (0 reads nothing).												*;
+;*																									*;
+;*OUTPUT:																							*;
+;*	None.																							*;
+;*																									*;
+;*REGISTER USAGE:																					*;
+;*	None.																							*;
+;*																									*;
+;*LOCAL STACK USAGE:																				*;
+;*	12-15 bytes, including calling this routine.													*;
+;*																									*;
+;*NOTES:																							*;
+;*	1.	This routine consumes ~60 MCU cycles plus 13 cycles per byte read and 11-19 cycles per		*;
+;*		occupied buffer slot, including returning to the calling program.							*;
+;*	2.	Interrupts stay enabled while streaming from EEPROM; only the EE_RDY interrupt is held off.	*;
+;*	3.	The block should not wrap around the end of the EEPROM address space.						*;
+;*--------------------------------------------------------------------------------------------------*/
+#ifndef ___EEPROM_LIB___
+		.extern	ee_read_block
+#else
+		.global ee_read_block
+#endif
+
+
+/*--------------------------------------------------------------------------------------------------*;
+;* ee_write_block: Write a block of bytes from SRAM to EEPROM.										*;
+;*--------------------------------------------------------------------------------------------------*;
+;*DESCRIPTION:																						*;
+;*	This function writes a block of bytes from SRAM to EEPROM, starting at the specified EEPROM		*;
+;*	location. The bytes are put in the EEPROM buffer, as many as fit in one go, so interrupts are	*;
+;*	disabled only once per chunk. Bytes for an address already waiting in the buffer just replace	*;
+;*	the buffered data byte.																			*;
+;*	Programming the bytes is controlled by the EE_RDY interrupt routine; we only wait when the		*;
+;*	buffer is full and return as soon as the last byte is in the buffer.							*;
+;*																									*;
+;*INPUT:																							*;
+;*	X(L) = EEPROM start address to write;															*;
+;*	Z = SRAM address of the data bytes to write;													*;
+;*	R24 = Number of bytes to write (0 writes nothing).												*;
+;*																									*;
+;*OUTPUT:																							*;
+;*	None.																							*;
+;*																									*;
+;*REGISTER USAGE:																					*;
+;*	None.																							*;
+;*																									*;
+;*LOCAL STACK USAGE:																				*;
+;*	13-16 bytes, including calling this routine.													*;
+;*																									*;
+;*NOTES:																							*;
+;*	1.	This routine consumes ~50 MCU cycles plus 25-35 cycles per byte written and 7-9 cycles per	*;
+;*		occupied buffer slot searched, including returning to the calling program, as long as		*;
+;*		the buffer does not fill up.																*;
+;*	2.	The block should not wrap around the end of the EEPROM address space.						*;
+;*--------------------------------------------------------------------------------------------------*/
+#ifndef ___EEPROM_LIB___
+		.extern	ee_write_block
+#else
+		.global ee_write_block
+#endif
+
+
+/*--------------------------------------------------------------------------------------------------*;
+;* ee_busy: Check if EEPROM writes are pending.														*;
+;*--------------------------------------------------------------------------------------------------*;
+;*DESCRIPTION:																						*;
+;*	Check if there are bytes in the buffer or the last byte is still being programmed.				*;
+;*																									*;
+;*INPUT:																							*;
+;*	None.																							*;
+;*																									*;
+;*OUTPUT:																							*;
+;*	CF=0: All bytes written are programmed in EEPROM;												*;
+;*	CF=1: EEPROM writes pending.																	*;
+;*																									*;
+;*REGISTER USAGE:																					*;
+;*	None.																							*;
+;*																									*;
+;*LOCAL STACK USAGE:																				*;
+;*	2 bytes, including calling this routine.														*;
+;*																									*;
+;*NOTES:																							*;
+;*	1.	This routine consumes 9-10 MCU cycles, including returning to the calling program.			*;
+;*	2.	The EE_RDY interrupt stays enabled until the last byte is programmed.						*;
+;*--------------------------------------------------------------------------------------------------*/
+#ifndef ___EEPROM_LIB___
+		.extern	ee_busy
+#else
+		.global ee_busy
+#endif
+
+
+/*--------------------------------------------------------------------------------------------------*;
+;* ee_sync: Wait until all EEPROM writes are programmed.											*;
+;*--------------------------------------------------------------------------------------------------*;
+;*DESCRIPTION:																						*;
+;*	This function waits until the buffer is empty and the last byte is programmed in EEPROM, with	*;
+;*	the MCU in Idle sleep mode in between interrupts. Use it e.g. before a controlled power down;	*;
+;*	it waits exactly as long as needed.																*;
+;*																									*;
+;*INPUT:																							*;
+;*	None.																							*;
+;*																									*;
+;*OUTPUT:																							*;
+;*	None.																							*;
+;*																									*;
+;*REGISTER USAGE:																					*;
+;*	None.																							*;
+;*																									*;
+;*LOCAL STACK USAGE:																				*;
+;*	3 bytes, including calling this routine.														*;
+;*																									*;
+;*NOTES:																							*;
+;*	1.	Interrupts are enabled on return.															*;
+;*	2.	Any interrupt wakes the MCU; the sleep mode bits are left in Idle mode.						*;
+;*--------------------------------------------------------------------------------------------------*/
+#ifndef ___EEPROM_LIB___
+		.extern	ee_sync
+#else
+		.global ee_sync
+#endif
+
+
+/*--------------------------------------------------------------------------------------------------*;
+;* ee_set_callback: Set the routine to call when all EEPROM writes are programmed.					*;
+;*--------------------------------------------------------------------------------------------------*;
+;*DESCRIPTION:																						*;
+;*	Set the routine to be called by the EE_RDY interrupt routine once the buffer is empty and the	*;
+;*	last byte is programmed in EEPROM.																*;
+;*																									*;
+;*INPUT:																							*;
+;*	Z = Program address of the routine to call (pm(label)), 0 = no callback.						*;
+;*																									*;
+;*OUTPUT:																							*;
+;*	None.																							*;
+;*																									*;
+;*REGISTER USAGE:																					*;
+;*	None.																							*;
+;*																									*;
+;*LOCAL STACK USAGE:																				*;
+;*	2 bytes, including calling this routine.														*;
+;*																									*;
+;*NOTES:																							*;
+;*	1.	The callback runs in interrupt context with interrupts disabled. It must save all registers	*;
+;*		it uses (R0 holds the saved SREG) and should not call EEPROM library routines; setting a	*;
+;*		flag for the main loop is the intended use.													*;
+;*--------------------------------------------------------------------------------------------------*/
+#ifndef ___EEPROM_LIB___
+		.extern	ee_set_callback
+#else
+		.global ee_set_callback
+#endif
+
+
+/*--------------------------------------------------------------------------------------------------*;
+;* ee_wl_init: Find the current slot of a wear-leveled EEPROM variable.								*;
+;*--------------------------------------------------------------------------------------------------*;
+;*DESCRIPTION:																						*;
+;*	A wear-leveled variable is spread over a ring of EEPROM slots, each holding a sequence marker	*;
+;*	followed by a copy of the variable. Every update goes to the next slot in the ring, so each		*;
+;*	EEPROM cell is programmed only once per EEWL_SLOTS updates. The markers count up 0..254			*;
+;*	(0xFF marks an erased slot); the current slot is the one whose successor does not continue the	*;
+;*	sequence.																						*;
+;*	This function scans the markers once and stores the current slot and its marker in the			*;
+;*	descriptor. Call it at boot, after setting up EEWL_ADDR, EEWL_SLOTS and EEWL_SIZE.				*;
+;*																									*;
+;*INPUT:																							*;
+;*	Y = SRAM address of the wear-leveled variable descriptor.										*;
+;*																									*;
+;*OUTPUT:																							*;
+;*	CF=0: Current slot found, EEWL_CUR and EEWL_SEQ updated;										*;
+;*	CF=1: No slot written yet, EEWL_CUR = EEWL_NONE.												*;
+;*																									*;
+;*REGISTER USAGE:																					*;
+;*	None.																							*;
+;*																									*;
+;*LOCAL STACK USAGE:																				*;
+;*	15-16 bytes, including calling this routine.													*;
+;*																									*;
+;*NOTES:																							*;
+;*	1.	This routine consumes ~40 MCU cycles plus one ee_readbyte call per slot scanned, including	*;
+;*		returning to the calling program. The scan stops at the current slot.						*;
+;*--------------------------------------------------------------------------------------------------*/
+#ifndef ___EEPROM_LIB___
+		.extern	ee_wl_init
+#else
+		.global ee_wl_init
+#endif
+
+
+/*--------------------------------------------------------------------------------------------------*;
+;* ee_wl_read: Read the current value of a wear-leveled EEPROM variable.							*;
+;*--------------------------------------------------------------------------------------------------*;
+;*DESCRIPTION:																						*;
+;*	This function copies the value in the current slot of a wear-leveled variable to SRAM. The		*;
+;*	current slot is taken from the descriptor, so no markers are scanned.							*;
+;*																									*;
+;*INPUT:																							*;
+;*	Y = SRAM address of the wear-leveled variable descriptor (see ee_wl_init);						*;
+;*	Z = SRAM address to store the EEWL_SIZE value bytes.											*;
+;*																									*;
+;*OUTPUT:																							*;
+;*	CF=0: Value read;																				*;
+;*	CF=1: No value written yet, SRAM left untouched.												*;
+;*																									*;
+;*REGISTER USAGE:																					*;
+;*	None.																							*;
+;*																									*;
+;*LOCAL STACK USAGE:																				*;
+;*	17-20 bytes, including calling this routine.													*;
+;*																									*;
+;*NOTES:																							*;
+;*	1.	This routine consumes ~40 MCU cycles plus 4-5 cycles per slot before the current one and	*;
+;*		one ee_read_block call, including returning to the calling program.							*;
+;*--------------------------------------------------------------------------------------------------*/
+#ifndef ___EEPROM_LIB___
+		.extern	ee_wl_read
+#else
+		.global ee_wl_read
+#endif
+
+
+/*--------------------------------------------------------------------------------------------------*;
+;* ee_wl_write: Write a new value to a wear-leveled EEPROM variable.								*;
+;*--------------------------------------------------------------------------------------------------*;
+;*DESCRIPTION:																						*;
+;*	This function writes the new value to the slot following the current one, then its sequence		*;
+;*	marker to commit it. As the EE_RDY interrupt programs the buffer first in, first out, the		*;
+;*	previous value stays valid until the marker is programmed. Finally the slot after the new one	*;
+;*	is erased to 0xFF, so the next update only needs the faster Write-only programming mode.		*;
+;*																									*;
+;*INPUT:																							*;
+;*	Y = SRAM address of the wear-leveled variable descriptor (see ee_wl_init);						*;
+;*	Z = SRAM address of the EEWL_SIZE value bytes to write.											*;
+;*																									*;
+;*OUTPUT:																							*;
+;*	EEWL_CUR and EEWL_SEQ updated.																	*;
+;*																									*;
+;*REGISTER USAGE:																					*;
+;*	None.																							*;
+;*																									*;
+;*LOCAL STACK USAGE:																				*;
+;*	22-25 bytes, including calling this routine.													*;
+;*																									*;
+;*NOTES:																							*;
+;*	1.	This routine waits until bytes written before are programmed; ring bytes still waiting in	*;
+;*		the buffer would otherwise be updated in place and lose their write order.					*;
+;*	2.	Only the new slot and its successor are touched, EEWL_SIZE+1 bytes each.					*;
+;*--------------------------------------------------------------------------------------------------*/
+#ifndef ___EEPROM_LIB___
+		.extern	ee_wl_write
+#else
+		.global ee_wl_write
+#endif
+
+
+/*--------------------------------------------------------------------------------------------------*;
+;* ee_rec_init: Validate an atomic EEPROM record.													*;
+;*--------------------------------------------------------------------------------------------------*;
+;*DESCRIPTION:																						*;
+;*	An atomic record is kept in two EEPROM slots, each holding the record data, a CRC16 over the	*;
+;*	data and a generation marker. Updates alternate between the slots and the generation marker is	*;
+;*	written last, so a slot is only complete when its CRC16 matches and its generation marker is	*;
+;*	set. If power fails halfway an update, the other slot still holds the previous record.			*;
+;*	This function validates both slots once and stores the newest valid slot in the descriptor.		*;
+;*	Call it at boot, after setting up EEREC_ADDR and EEREC_SIZE; ee_rec_read then trusts it.		*;
+;*																									*;
+;*INPUT:																							*;
+;*	Y = SRAM address of the atomic record descriptor.												*;
+;*																									*;
+;*OUTPUT:																							*;
+;*	CF=0: Valid record found, EEREC_CUR and EEREC_GEN updated;										*;
+;*	CF=1: No valid record, EEREC_CUR = EEREC_NONE.													*;
+;*																									*;
+;*REGISTER USAGE:																					*;
+;*	None.																							*;
+;*																									*;
+;*LOCAL STACK USAGE:																				*;
+;*	18-19 bytes, including calling this routine.													*;
+;*																									*;
+;*NOTES:																							*;
+;*	1.	This routine reads both slots from EEPROM, consuming ~70 MCU cycles per byte.				*;
+;*	2.	Algorithm: CRC-16-CCITT, x16 + x12 + x5 + 1, 0x1021, initial value 0xFFFF.					*;
+;*--------------------------------------------------------------------------------------------------*/
+#ifndef ___EEPROM_LIB___
+		.extern	ee_rec_init
+#else
+		.global ee_rec_init
+#endif
+
+
+/*--------------------------------------------------------------------------------------------------*;
+;* ee_rec_read: Read an atomic EEPROM record.														*;
+;*--------------------------------------------------------------------------------------------------*;
+;*DESCRIPTION:																						*;
+;*	This function copies the record data from the valid slot to SRAM. The slot is taken from the	*;
+;*	descriptor as validated by ee_rec_init, so no CRC16 is calculated.								*;
+;*																									*;
+;*INPUT:																							*;
+;*	Y = SRAM address of the atomic record descriptor (see ee_rec_init);								*;
+;*	Z = SRAM address to store the EEREC_SIZE data bytes.											*;
+;*																									*;
+;*OUTPUT:																							*;
+;*	CF=0: Record read;																				*;
+;*	CF=1: No valid record, SRAM left untouched.														*;
+;*																									*;
+;*REGISTER USAGE:																					*;
+;*	None.																							*;
+;*																									*;
+;*LOCAL STACK USAGE:																				*;
+;*	16-19 bytes, including calling this routine.													*;
+;*																									*;
+;*NOTES:																							*;
+;*	1.	This routine consumes ~35 MCU cycles plus one ee_read_block call, including returning to	*;
+;*		the calling program.																		*;
+;*--------------------------------------------------------------------------------------------------*/
+#ifndef ___EEPROM_LIB___
+		.extern	ee_rec_read
+#else
+		.global ee_rec_read
+#endif
+
+
+/*--------------------------------------------------------------------------------------------------*;
+;* ee_rec_write: Write an atomic EEPROM record.														*;
+;*--------------------------------------------------------------------------------------------------*;
+;*DESCRIPTION:																						*;
+;*	This function writes the record data to the slot not holding the valid record, followed by		*;
+;*	the CRC16 over the data and the next generation marker. As the EE_RDY interrupt programs the	*;
+;*	buffer first in, first out, the generation marker commits the new record only after all other	*;
+;*	bytes are programmed; until then ee_rec_init finds the previous record.							*;
+;*																									*;
+;*INPUT:																							*;
+;*	Y = SRAM address of the atomic record descriptor (see ee_rec_init);								*;
+;*	Z = SRAM address of the EEREC_SIZE data bytes to write.											*;
+;*																									*;
+;*OUTPUT:																							*;
+;*	EEREC_CUR and EEREC_GEN updated.																*;
+;*																									*;
+;*REGISTER USAGE:																					*;
+;*	None.																							*;
+;*																									*;
+;*LOCAL STACK USAGE:																				*;
+;*	25-28 bytes, including calling this routine.													*;
+;*																									*;
+;*NOTES:																							*;
+;*	1.	This routine waits until bytes written before are programmed; record bytes still waiting	*;
+;*		in the buffer would otherwise be updated in place and lose their write order.				*;
+;*	2.	Subsequent ee_rec_read calls return the new record, even before it is programmed.			*;
+;*--------------------------------------------------------------------------------------------------*/
+#ifndef ___EEPROM_LIB___
+		.extern	ee_rec_write
+#else
+		.global ee_rec_write
+#endif
+
+
+/*--------------------------------------------------------------------------------------------------*;
+;* ee_kv_init: Build the index of the EEPROM key-value store.										*;
+;*--------------------------------------------------------------------------------------------------*;
+;*DESCRIPTION:																						*;
+;*	The key-value store is a log of [key][length][value] entries in the EEPROM area EE_KV_START..	*;
+;*	EE_KV_START+EE_KV_SIZE-1, ended by a key of 0xFF. Updates are appended to the log and the key	*;
+;*	byte of a new entry is written last, so an interrupted update is never found. A zero length		*;
+;*	entry deletes the key.																			*;
+;*	This function scans the log once and builds an index in SRAM holding the offset of the latest	*;
+;*	entry of every key, so ee_kv_get never scans the EEPROM. Call it at boot.						*;
+;*																									*;
+;*INPUT:																							*;
+;*	None.																							*;
+;*																									*;
+;*OUTPUT:																							*;
+;*	None.																							*;
+;*																									*;
+;*REGISTER USAGE:																					*;
+;*	None.																							*;
+;*																									*;
+;*LOCAL STACK USAGE:																				*;
+;*	17-20 bytes, including calling this routine.													*;
+;*																									*;
+;*NOTES:																							*;
+;*	1.	This routine reads two bytes through ee_readbyte for every entry in the log.				*;
+;*	2.	The scan stops at the first invalid entry; the next ee_kv_put appends from there.			*;
+;*--------------------------------------------------------------------------------------------------*/
+#ifndef ___EEPROM_LIB___
+		.extern	ee_kv_init
+#else
+		.global ee_kv_init
+#endif
+
+
+/*--------------------------------------------------------------------------------------------------*;
+;* ee_kv_get: Read the value of a key from the EEPROM key-value store.								*;
+;*--------------------------------------------------------------------------------------------------*;
+;*DESCRIPTION:																						*;
+;*	This function looks up the key in the SRAM index and copies its value to SRAM.					*;
+;*																									*;
+;*INPUT:																							*;
+;*	R24 = Key (0..EE_KV_KEYS-1);																	*;
+;*	Z = SRAM address to store the value (room for the longest value of this key).					*;
+;*																									*;
+;*OUTPUT:																							*;
+;*	CF=0: Key found, R24 = value length;															*;
+;*	CF=1: Key not found.																			*;
+;*																									*;
+;*REGISTER USAGE:																					*;
+;*	R24.																							*;
+;*																									*;
+;*LOCAL STACK USAGE:																				*;
+;*	17-20 bytes, including calling this routine.													*;
+;*																									*;
+;*NOTES:																							*;
+;*	1.	This routine consumes ~50 MCU cycles plus one ee_readbyte and one ee_read_block call,		*;
+;*		including returning to the calling program.													*;
+;*--------------------------------------------------------------------------------------------------*/
+#ifndef ___EEPROM_LIB___
+		.extern	ee_kv_get
+#else
+		.global ee_kv_get
+#endif
+
+
+/*--------------------------------------------------------------------------------------------------*;
+;* ee_kv_put: Write the value of a key to the EEPROM key-value store.								*;
+;*--------------------------------------------------------------------------------------------------*;
+;*DESCRIPTION:																						*;
+;*	This function appends a new entry for the key to the log: the value first, then its length,		*;
+;*	then a new end of log marker and, last, the key byte that commits the entry. A zero length		*;
+;*	deletes the key. When the area is full, the log is compacted first.								*;
+;*																									*;
+;*INPUT:																							*;
+;*	R24 = Key (0..EE_KV_KEYS-1);																	*;
+;*	R25 = Value length (0 = delete key);															*;
+;*	Z = SRAM address of the value bytes.															*;
+;*																									*;
+;*OUTPUT:																							*;
+;*	CF=0: Value stored;																				*;
+;*	CF=1: Invalid key or no room left, even after compaction.										*;
+;*																									*;
+;*REGISTER USAGE:																					*;
+;*	None.																							*;
+;*																									*;
+;*LOCAL STACK USAGE:																				*;
+;*	25-30 bytes, including calling this routine.													*;
+;*																									*;
+;*NOTES:																							*;
+;*	1.	This routine waits until bytes written before are programmed; the end of log marker of the	*;
+;*		previous entry, if still in the buffer, would take the key byte ahead of the value.			*;
+;*	2.	Compaction rewrites the log in place and is not power fail safe.							*;
+;*--------------------------------------------------------------------------------------------------*/
+#ifndef ___EEPROM_LIB___
+		.extern	ee_kv_put
+#else
+		.global ee_kv_put
+#endif
+
 #endif //___EEPROM_H___
 
 
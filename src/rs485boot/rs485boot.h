@@ -0,0 +1,121 @@
+/*==================================================================================================*
+ *SYNOPSIS:
+ *	Include file for the RS485 bootloader: firmware update of the Slaves over the RS485 bus.
+ *
+ *VERSION HISTORY:
+ *	20261018 v0.1	Initial version.
+ *
+ *DESCRIPTION:
+ *	The bootloader lives in the boot section of the ATmega88/168/328(P) or ATmega1284(P) (BOOTRST
+ *	fuse programmed) and receives flash pages over the RS485 bus with the frame format, CRC16 and
+ *	addressing of the rs485lib library (see rs485lib.h): 9-bit address byte, Command, parameter
+ *	length, 0-12 parameters and the CRC16. It polls the USART (no interrupts) and programs the
+ *	application section with SPM. The Slave address is read from EEPROM (RS485BOOT_EE_ADDR).
+ *
+ *	After reset the bootloader waits RS485BOOT_TIMEOUT ms for a bootloader Command addressed at
+ *	this Slave or broadcast (counted from reset: other bus traffic doesn't extend it), then starts
+ *	the application (unless there is none). Any bootloader Command keeps it in the bootloader
+ *	until RS485BOOT_EXIT. The application can also enter the bootloader, without timeout, with
+ *	"jmp RS485BOOT_START+2" (interrupts disabled). The bootloader stops the watchdog, and passes
+ *	the reset flags (MCUSR) to the application in R2.
+ *
+ *	A firmware update is a broadcast stream of the pages to all Slaves at once, followed by a
+ *	verification per Slave:
+ *	1.	RS485BOOT_ENTER broadcast (a few times, while the Slaves reset), then RS485BOOT_ENTER to
+ *		each Slave with RESP set: page size and signature, so the Master can check them.
+ *	2.	Per page: RS485BOOT_DATA broadcasts with up to 8 bytes each (at least one, the first one
+ *		starts the page all 0xFF), then RS485BOOT_WRITE with the CRC16 of the whole page. Each
+ *		Slave collects the page in RAM, checks the CRC16, and erases, writes and verifies the
+ *		flash page; a page with a wrong CRC16 (e.g. a lost DATA frame) is not written but counted
+ *		as failed. The Master waits for the page write (about 10 ms) before the next page, as the
+ *		Slaves don't receive while writing. The first page written other than page 0 erases page 0
+ *		(about 4 ms more), and the Master sends page 0 last: an update that is cut short leaves no
+ *		reset vector, so the Slave stays in the bootloader after reset until it is updated again.
+ *	3.	RS485BOOT_VERIFY to each Slave: failed page count, first failed page and the CRC16 of the
+ *		flash pages. A Slave with failures or a wrong CRC16 gets the failed pages again, now
+ *		addressed at it with RESP set on RS485BOOT_WRITE, page 0 again last.
+ *	4.	RS485BOOT_EXIT to each verified Slave (or broadcast): start the application.
+ *
+ * COMMANDS:
+ *	Command			   Parameters (Request)						   Parameters (Response)
+ *	-------------------+-------------------------------------------+-----------------------------
+ *	RS485BOOT_ENTER		-										  0-1 page size, 2-4 signature,
+ *																	  5 version, 6-7 app. pages
+ *	RS485BOOT_DATA		0-1 page, 2 offset, 3.. data (2-8 bytes)  -
+ *	RS485BOOT_WRITE		0-1 page, 2-3 CRC16 of the page			  0 status (RS485BOOT_xxx)
+ *	RS485BOOT_VERIFY	0-1 first page, 2-3 number of pages		  0 failed pages, 1-2 first
+ *																	  failed page, 3-4 CRC16
+ *	RS485BOOT_EXIT		-										  -
+ *
+ *	All 16-bit values are low byte first; the CRC16s are calculated like the message CRC16
+ *	(CCITT 0x1021, preset 0xFFFF). RS485BOOT_ENTER clears the failed page count.
+ *
+ * USED MAKEFILE ENTRIES:
+ *	 Name				   | Explanation										   | Default value
+ *	-----------------------+-------------------------------------------------------+---------------
+ *	 F_CPU					 Clock frequency in Hz.									 8000000
+ *	 BAUD					 Baud rate of the bus.									 38400
+ *	 RS485_USART			 USART used: 0 = USART0, 1 = USART1 (ATmega1284).		 0
+ *	 RS485_DIR_xxx			 Direction pin of the transceiver, as in rs485lib.		 PD2/PD4
+ *	 RS485BOOT_SIZE			 Size of the boot section in bytes (BOOTSZ fuses).		 2048
+ *	 RS485BOOT_TIMEOUT		 Time in ms to wait for the bootloader after reset.		 1000
+ *	 RS485BOOT_EE_ADDR		 EEPROM address of the Slave address (1-127).			 E2END
+ *	 RS485BOOT_ADDRESS		 Fixed Slave address instead of the EEPROM byte.		 -
+ *
+ *	Link the bootloader on its own at the boot section, e.g. for the ATmega328P:
+ *	avr-gcc -mmcu=atmega328p -DF_CPU=16000000 -DBAUD=38400 -nostartfiles
+ *		-Wl,--section-start=.text=0x7800 -o rs485boot.elf rs485boot.S
+ *
+ *COPYRIGHT:
+ *	(c)2014 by Ron Moerman, All Rights Reserved.
+ *
+ *	$File: rs485boot.h $
+ *	$Revision: 0.1 $
+ *	$IDE: Atmel Studio 6.2 $
+ *	$Author: Ron Moerman $
+ *	$Email: ron(at)moerman.cc $
+ *	$Date: Sunday, October 18, 2026 23:59:48 UTC $
+ *==================================================================================================*/
+
+#ifndef __RS485BOOT_H__
+#define __RS485BOOT_H__
+
+/*==================================================================================================*
+ *                                    I N C L U D E   H E A D E R S
+ *==================================================================================================*/
+
+#include <rs485lib.h>
+
+
+/*==================================================================================================*
+ *                                         C O N S T A N T S
+ *==================================================================================================*/
+
+; Bootloader version, returned by RS485BOOT_ENTER.
+RS485BOOT_VERSION = 1
+
+; Size of the boot section in bytes (BOOTSZ fuses) and its start address.
+#ifndef RS485BOOT_SIZE
+	#define RS485BOOT_SIZE 2048
+#endif
+#define RS485BOOT_START (FLASHEND+1-RS485BOOT_SIZE)
+; Number of application pages (pages below the boot section).
+#define RS485BOOT_PAGES (RS485BOOT_START/SPM_PAGESIZE)
+
+; Bootloader Commands (never used by the application while the bootloader runs).
+RS485BOOT_ENTER = 0xF0									;Stay in the bootloader; report page size.
+RS485BOOT_DATA = 0xF1									;Page data (up to 8 bytes).
+RS485BOOT_WRITE = 0xF2									;Check and program the collected page.
+RS485BOOT_VERIFY = 0xF3									;Report failed pages and CRC16 of pages.
+RS485BOOT_EXIT = 0xF4									;Start the application.
+
+; Maximum number of data bytes in a RS485BOOT_DATA message.
+RS485BOOT_DATA_LEN = 8
+
+; Status of RS485BOOT_WRITE.
+RS485BOOT_OK = 0										;Page written and verified.
+RS485BOOT_BAD_DATA = 1									;Page not (completely) received: CRC16 wrong.
+RS485BOOT_PROTECTED = 2									;Page is in the boot section.
+RS485BOOT_BAD_FLASH = 3									;Page written, but flash differs.
+
+#endif
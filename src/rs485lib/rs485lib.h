@@ -3,6 +3,24 @@
  *	Include file for use of Atmel AVR Library of RS485 Master and Slave functions.
  *
  *VERSION HISTORY:
+ *	20261018 v0.20	CRC16 update as macro RS485_CRC_UPDATE, shared with the rs485boot bootloader.
+ *	20261018 v0.19	Frame format 9N1 as documented (no parity, 1 stop bit) instead of 9O2.
+ *	20261018 v0.18	Faster RX ISR with GPIOR registers and a trimmed prologue (RS485_RX_FAST).
+ *	20261018 v0.17	Added sequence numbers and a response cache for retries (RS485_RESP_CACHE).
+ *	20261018 v0.16	Added multicast group addresses, matched in the RX ISR (RS485_group_xxx).
+ *	20261018 v0.15	Added non-blocking transmit queue for RS485_send_message (RS485_TXQ_SIZE).
+ *	20261018 v0.14	Bus turnaround timed by Timer0 in bit times (RS485_TURNAROUND_BITS).
+ *	20261018 v0.13	Added flash command dispatch table with automatic response (RS485_dispatch).
+ *	20261018 v0.12	Added TDMA report slots, started by a Master sync frame (RS485_tdma_xxx).
+ *	20261018 v0.11	Added bus statistics counters (RS485_STATS, RS485_stats_xxx).
+ *	20261018 v0.10	Added batch messages with several command tuples (RS485_batch_xxx).
+ *	20261018 v0.9	Added ATmega48-328/ATmega1284 support, RS485_USART; U2X used if needed.
+ *	20261018 v0.8	Added Master poll scheduler with response timeouts and retries (RS485_POLL_SLAVES).
+ *	20261018 v0.7	Message bytes sent from the UDRE ISR; TXC ISR only for direction turnaround.
+ *	20261018 v0.6	Ring of RS485_RX_SLOTS receive buffers; added RS485_release.
+ *	20261018 v0.5	Variable length messages (RS485MSG_PLEN); only the used parameters are sent.
+ *	20261018 v0.4	CRC16 calculated/checked per byte in the TX/RX ISR's (RS485MSG_RCRC).
+ *	20261018 v0.3	Added table driven CRC16 option (RS485_CRC_TABLE).
  *	20140922 v0.1	Initial test version.
  *
  *DESCRIPTION:
@@ -22,35 +40,39 @@
  *	The MPCM mode frees the Slaves from filtering data bytes not meant for them, so they can spent
  *	their time on more important tasks.
  *
- *	Currently only the ATtiny2313(A) MCU devices are supported. Besides the USART of the
- *	ATtiny2313(A), the port pin PD3 (can be redefined at Library compile time) is used to switch
- *	directions on the RS485 transceiver. PD0 (RXD)and PD1 (TXD) are used by the USART as Receive
- *	and Transmit lines.
+ *	The ATtiny2313/4313, ATmega48/88/168/328(P) and ATmega1284(P) MCU devices are supported.
+ *	Besides the USART (USART0, or USART1 on the ATmega1284 selected with RS485_USART), the port pin
+ *	PD3 (ATtiny), PD2 (ATmega48-328) or PD4 (ATmega1284) (can be redefined at Library compile time)
+ *	is used to switch directions on the RS485 transceiver. PD0 (RXD) and PD1 (TXD) are used by
+ *	USART0 as Receive and Transmit lines (PD2/PD3 by USART1 of the ATmega1284).
  *
  *	The RS485 library supports two types of messages: Request & Response.
  *
  * REQUEST MESSAGES:
- *	Request messages do have the following structure, where the number of data bytes is currently
- *	limited to eight. You can change that limit by adapting the definition of NB_PARAM_BYTES.
- *	You can adapt the library to your application by setting an application specific value for
- *	NB_PARAM_BYTES in your makefile. Don't change anything if you can live with eight bytes.
+ *	Request messages do have the following structure, where the number of parameter bytes is
+ *	limited to RS485PARAM_LEN (12). Only the given number of parameters is sent, directly followed
+ *	by the CRC16 over all bytes sent, so short commands take less bus time.
  *
  *  +----+
  *  |  0 | - Address (0-128)
  *  +----+
  *  |  1 | - Command (0-255)
  *  +----+
- *  |  2 | - Number of parameters (0-8)
+ *  |  2 | - Number of parameters N (0-12)
  *  +----+
  *  |  3 | - First parameter (0-255)
  *  +----+
- *  |  3 | - Second parameter (0-255)
+ *  |  4 | - Second parameter (0-255)
  *  +----+
  *  |    |
  *   ...
  *  |    |
  *  +----+
- *  | 10 | - Eighth parameter (0-255)
+ *  |N+2 | - Last parameter (0-255)
+ *  +----+
+ *  |N+3 | - CRC16 low byte
+ *  +----+
+ *  |N+4 | - CRC16 high byte
  *  +----+
  *
  *	Please note that the address byte has the following structure:
@@ -67,24 +89,51 @@
  *	broadcast. RESP cannot be set in case of broadcast address.
  *
  * RESPONSE MESSAGES:
- *	Response messages do have the following structure, where the number of data bytes currently is
- *	limited to 8. You can change that limit by adapting the definition of NB_RET_BYTES.
- *	You can adapt the library to your application by setting an application specific value for
- *	NB_RET_BYTES in your makefile. Don't change anything if you can live with eight bytes.
- *
- *	+----+
- *	|  0 | - Number of return values (0-8)
- *	+----+
- *	|  1 | - First return value (0-255)
- *	+----+
- *	|  3 | - Second return value (0-255)
- *	+----+
- *	|    |
- *	 ...
- *	|    |
- *	+----+
- *	|  8 | - Eighth return value (0-255)
- *	+----+
+ *	Response messages do have the same structure as Request messages, where byte 0 holds the
+ *	address of the responding Slave, byte 1 the Result and byte 2 the number of return values.
+ *	In the message buffer the CRC16 is always kept at RS485MSG_CRC16, after the parameter buffer.
+ *
+ * SEQUENCE NUMBERS:
+ *	With RS485_RESP_CACHE=1, bits 7-4 of the parameter length byte on the bus carry a sequence
+ *	number (1-15, 0 = none), kept at RS485MSG_SEQ in the message buffer (bits 7-4 too), so
+ *	RS485MSG_PLEN always holds the plain parameter length. A Master gives each new request to a
+ *	Slave the next sequence number and a retry the same one; RS485_dispatch answers a retry of
+ *	the last request from its response cache, without calling the handler again. The response
+ *	echoes the sequence number of the request.
+ *
+ * BATCH MESSAGES:
+ *	A batch message (Command/Result RS485CMD_BATCH) carries several commands in one Request, and
+ *	their results in one Response, so the address, CRC16 and direction turnaround are paid once.
+ *	The parameters are a sequence of tuples, each with the standard message layout from byte 1:
+ *
+ *  +----+----+----------------+----+----+----------------+
+ *  |CMD | N  | N parameters   |CMD | N  | N parameters   | ...
+ *  +----+----+----------------+----+----+----------------+
+ *
+ *	RS485_batch_first/RS485_batch_next return each tuple as a sub-message view (Y) that is
+ *	addressed with RS485MSG_CMD, RS485MSG_PLEN and RS485MSG_PARAM like a single message.
+ *
+ * COMMAND DISPATCH:
+ *	Instead of a compare chain on RS485MSG_CMD, a Slave can call RS485_dispatch from its main loop
+ *	with a flash table of N+1 handler addresses: one per Command 0..N-1 and one for all unknown
+ *	Commands. The handler is found in constant time, called with Y = request and X = response,
+ *	and the response is sent when the Master expects one.
+ *
+ *	cmd_table:	.word	pm(cmd_get)						;Command 0.
+ *				.word	pm(cmd_set)						;Command 1.
+ *				.word	pm(cmd_unknown)					;Commands 2..255.
+ *
+ * TDMA REPORT SLOTS:
+ *	Instead of polling each Slave with a Request and a Response, the Master can broadcast a TDMA
+ *	sync frame (RS485_tdma_sync: Command RS485CMD_TDMA_SYNC to address 0 with RESP set). Each
+ *	Slave then sends its pending report (RS485_tdma_report) in its own time slot, timed by Timer1:
+ *
+ *  +------+--------+--------+--------+-     -+--------+
+ *  | SYNC | slot 0 | slot 1 | slot 2 |  ...  | slot N |    N = RS485_TDMA_SLOTS
+ *  +------+--------+--------+--------+-     -+--------+
+ *
+ *	Slot 0 is the Master's direction turnaround; Slave n sends in slot n. The sync frame is not
+ *	handed to the Slave application, the reports are received by the Master as normal messages.
  *
  * USED MAKEFILE ENTRIES:
  *	 Name				   | Explanation										   | Default value
@@ -96,9 +145,39 @@
  *							 to produce all standard baud rates with no error.
  *							 The compiler will issue a warning in case CPU clock
  *							 and baud rate do not match (error rate to high).
- *	 RS485_SWITCHING_DELAY	 Delay in ms. Short delay will be performed after		 5
- *							 receiving the last byte from the request and
- *							 switching the Slave bus transceiver to send mode.
+ *							 U2X is used when util/setbaud.h asks for it; with a
+ *							 16 MHz crystal 250k, 500k and 1M baud have no error.
+ *	 RS485_USART			 USART used: 0 = USART0, 1 = USART1 (ATmega1284).		 0
+ *	 RS485_TURNAROUND_BITS	 Bus turnaround in bit times (0-255): a message is		 0
+ *							 not sent before this time has passed since the end
+ *							 of the last received message; timed by Timer0
+ *							 without busy-waiting. 0 = no delay (no Timer0).
+ *	 RS485_CRC_TABLE		 1 = calculate the CRC16 with a 512 byte flash lookup	 0
+ *							 table (44 instead of 55 CPU cycles per byte).
+ *	 RS485_RX_SLOTS			 Number of receive message buffers (1-11). Messages		 2
+ *							 are received in the next free buffer while the
+ *							 application processes earlier ones.
+ *	 RS485_POLL_SLAVES		 Maximum number of poll table entries (0-32) of the		 0
+ *							 Master poll scheduler; 0 = no scheduler. Timer1 is
+ *							 used for the 1 ms tick of the scheduler.
+ *	 RS485_POLL_RETRIES		 Number of retries after a response timeout before		 2
+ *							 a polled slave is marked offline (0-126).
+ *	 RS485_STATS			 1 = keep saturating 16-bit bus statistics counters		 0
+ *							 (RS485STAT_xxx) in the ISR's; see RS485_stats_xxx.
+ *	 RS485_TDMA_SLOT		 TDMA slot length in us; 0 = no TDMA report slots.		 0
+ *							 Should fit a report message and the interrupt
+ *							 latency (e.g. 5500 at 38400 baud). Timer1 is used
+ *							 for the slot timing.
+ *	 RS485_TDMA_SLOTS		 Number of TDMA report slots (Slaves 1-N, 1-127).		 16
+ *	 RS485_TXQ_SIZE			 Transmit queue size (0-16): RS485_send_message			 0
+ *							 queues messages while the bus is busy and the ISR's
+ *							 send them in order. 0 = wait while busy (blocking).
+ *	 RS485_GROUPS			 Number of multicast groups a Slave can join (0-8).		 0
+ *							 The RX ISR checks them next to our own address.
+ *	 RS485_RESP_CACHE		 1 = sequence numbers in the length byte, and a			 0
+ *							 response cache in RS485_dispatch for retries.
+ *	 RS485_RX_FAST			 1 = fast RX ISR path, keeping the receive index and	 0
+ *							 count in GPIOR0-2 (not free for the application).
  *
  *NOTES:
  *	Example usage of the Slave library routines:
@@ -129,11 +208,11 @@
  *	(c)2014 by Ron Moerman, All Rights Reserved.
  *
  *	$File: RS485Lib.h $
- *	$Revision: 0.1 $
+ *	$Revision: 0.20 $
  *	$IDE: Atmel Studio 6.2 $
  *	$Author: Ron Moerman $
  *	$Email: ron(at)moerman.cc $
- *	$Date: Sunday, September 22, 2014 18:45:22 UTC $
+ *	$Date: Sunday, October 18, 2026 23:59:48 UTC $
  *==================================================================================================*/
 
 #ifndef __RS485LIB_H__
@@ -154,23 +233,125 @@
 #define STATR R21										//R21 holds the current library TX/RX state.
 
 
-; RS485 Message parameter length (fixed).
-RS485PARAM_LEN = 12										;Message parameter length (fixed).
+; RS485 Message parameter length (maximum).
+RS485PARAM_LEN = 12										;Maximum message parameter length.
+; Sequence numbers and response cache for retries (0 = none, 1 = RS485MSG_SEQ and RS485_dispatch cache).
+#ifndef RS485_RESP_CACHE
+	#define RS485_RESP_CACHE 0
+#endif
 ; Structure of the RS485 message (Request and Response).
 RS485MSG_ADDR = 0										;Address byte (Slave or Boardcast address).
 RS485MSG_CMD = 1										;Command/Result byte.
-RS485MSG_PARAM = 2										;Parameter data buffer address.
-RS485MSG_CRC16 = 14										;CRC16 value.
-RS485MSG_LEN = 16										;Fixed RS485 message length (16).
+RS485MSG_PLEN = 2										;Number of parameter bytes sent (0-RS485PARAM_LEN).
+RS485MSG_PARAM = 3										;Parameter data buffer address.
+RS485MSG_CRC16 = (RS485MSG_PARAM+RS485PARAM_LEN)		;CRC16 value (sent right after the last parameter).
+RS485MSG_LEN = (RS485MSG_CRC16+2)						;Maximum RS485 message length (17).
 ; Additional message structure variables to manage transmitting/receiving of the message data.
 RS485MSG_IDX = (RS485MSG_CRC16+2)						;Index pointer for next message byte to process.
 RS485MSG_CNT = (RS485MSG_IDX+2)							;Count down for message bytes.
-RS485MSG_USED = (RS485MSG_CNT+1)						;Indicate if an active message is in the buffer.
-#define RS485MSG_SIZE 20								;Total length of RS485 message data structure.
+RS485MSG_USED = (RS485MSG_CNT+1)						;Receive slot state (RS485SLOT_xxx).
+RS485MSG_RCRC = (RS485MSG_USED+1)						;Running CRC16, updated per byte by the TX/RX ISR's.
+#if (RS485_RESP_CACHE)
+RS485MSG_SEQ = (RS485MSG_RCRC+2)						;Sequence number (bits 7-4), sent with the length byte.
+#define RS485MSG_SIZE 24								;Total length of RS485 message data structure.
+#else
+#define RS485MSG_SIZE 23								;Total length of RS485 message data structure.
+#endif
+
+; Number of receive message buffers (ring); the application reserves RS485_RX_SLOTS*RS485MSG_SIZE bytes.
+#ifndef RS485_RX_SLOTS
+	#define RS485_RX_SLOTS 2
+#endif
+#if (RS485_RX_SLOTS < 1) || (RS485_RX_SLOTS > 11) || (RS485_RESP_CACHE && (RS485_RX_SLOTS > 10))	//Ring must fit in 255 bytes.
+	#error "RS485_RX_SLOTS must be 1..11 (1..10 with RS485_RESP_CACHE)"
+#endif
+; Receive slot states (RS485MSG_USED).
+RS485SLOT_FREE = 0										;Slot free for the RX ISR.
+RS485SLOT_RECV = 1										;RX ISR is receiving a message in this slot.
+RS485SLOT_FULL = 2										;Message waiting to be consumed.
+RS485SLOT_HELD = 3										;Message consumed, in use until released.
+
+; Maximum number of poll table entries of the Master poll scheduler (0 = no scheduler).
+#ifndef RS485_POLL_SLAVES
+	#define RS485_POLL_SLAVES 0
+#endif
+#if (RS485_POLL_SLAVES < 0) || (RS485_POLL_SLAVES > 32)	//Entry offset (5*index) must fit in a byte.
+	#error "RS485_POLL_SLAVES must be 0..32"
+#endif
+; Structure of a poll table entry (in flash).
+RS485POLL_ADDR = 0										;Slave address (1-127).
+RS485POLL_CMD = 1										;Command byte of the poll request.
+RS485POLL_TIMEOUT = 2									;Response timeout in ms (1-255).
+RS485POLL_IVAL = 3										;Poll interval in ms (16-bit, low byte first).
+RS485POLL_SIZE = 5										;Size of a poll table entry.
+
+; Bus turnaround in bit times after a received message, before a message is sent (0 = no delay).
+#ifndef RS485_TURNAROUND_BITS
+	#define RS485_TURNAROUND_BITS 0
+#endif
+#if (RS485_TURNAROUND_BITS < 0) || (RS485_TURNAROUND_BITS > 255)
+	#error "RS485_TURNAROUND_BITS must be 0..255"
+#endif
+
+; Transmit queue size in messages (0 = RS485_send_message waits while the interface is busy).
+#ifndef RS485_TXQ_SIZE
+	#define RS485_TXQ_SIZE 0
+#endif
+#if (RS485_TXQ_SIZE < 0) || (RS485_TXQ_SIZE > 16)
+	#error "RS485_TXQ_SIZE must be 0..16"
+#endif
+
+; Number of multicast group addresses a Slave can join (0 = no groups).
+#ifndef RS485_GROUPS
+	#define RS485_GROUPS 0
+#endif
+#if (RS485_GROUPS < 0) || (RS485_GROUPS > 8)
+	#error "RS485_GROUPS must be 0..8"
+#endif
+
+; Fast RX ISR path with the receive index and count down in GPIOR0-2 (0 = normal ISR).
+#ifndef RS485_RX_FAST
+	#define RS485_RX_FAST 0
+#endif
+#if (RS485_RX_FAST) && !defined(GPIOR2)
+	#error "RS485_RX_FAST needs GPIOR0-2 on this device"
+#endif
+
+; Bus statistics counters (0 = none); costs about 220 bytes flash for the counting in the ISR's.
+#ifndef RS485_STATS
+	#define RS485_STATS 0
+#endif
+; Offsets of the saturating 16-bit counters (low byte first) copied by RS485_stats_snapshot.
+RS485STAT_BUS = 0										;Address frames seen on the bus.
+RS485STAT_ADDR = 2										;Messages addressed at us (or broadcast).
+RS485STAT_RX = 4										;Messages received with valid length and CRC16.
+RS485STAT_TX = 6										;Messages sent.
+RS485STAT_CRC = 8										;Messages dropped for an invalid CRC16.
+RS485STAT_FRAME = 10									;Frame, data overrun and parity errors.
+RS485STAT_DROP = 12										;Messages dropped (all slots full, invalid length).
+RS485STAT_RESET = 14									;State machine resets.
+RS485STAT_SIZE = 16										;Size of the counter snapshot.
+
+; TDMA report slot length in us (0 = no TDMA) and number of report slots (Slaves 1-RS485_TDMA_SLOTS).
+#ifndef RS485_TDMA_SLOT
+	#define RS485_TDMA_SLOT 0
+#endif
+#ifndef RS485_TDMA_SLOTS
+	#define RS485_TDMA_SLOTS 16
+#endif
+#if (RS485_TDMA_SLOTS < 1) || (RS485_TDMA_SLOTS > 127)
+	#error "RS485_TDMA_SLOTS must be 1..127"
+#endif
 
 ; The 8th address bit indicates whether the Master expects a Response (only valid for non-broadcast).
 RESPONSE_EXPECTED = 0x80
 
+; Command/Result byte of a batch message (parameters are [Command][N][N parameters] tuples).
+RS485CMD_BATCH = 0xFF
+
+; Command byte of a TDMA sync frame (broadcast with RESP set; starts the Slave report slots).
+RS485CMD_TDMA_SYNC = 0xFE
+
 ; Finite State Machine states.
 RS485STATE_INIT = 0										;RS485 not yet initialized.
 RS485STATE_REQUEST = 1									;Ready to Transmit/Receive Request or Broadcast.
@@ -193,6 +374,43 @@ RS485ERR_INVALID_STATE_SENDING = 8						;State machine confused somehow when sen
 RS485ERR_REQUEST_DROPPED = 9							;Message not consumed yet, subsequent messages are dropped.
 RS485ERR_INVALID_CRC = 10								;Invalid CRC16 value in message.
 RS485ERR_FRAME_ERROR = 11								;Receive frame error.
+RS485ERR_SLAVE_OFFLINE = 12								;Polled slave did not respond, marked offline.
+RS485ERR_INVALID_POLL_TABLE = 13						;Invalid number of poll table entries.
+RS485ERR_INVALID_TDMA_SLOT = 14							;Our address has no TDMA report slot.
+RS485ERR_TDMA_SLOT_MISSED = 15							;Still busy at start of our slot, report kept.
+RS485ERR_TX_QUEUE_FULL = 16								;Transmit queue full, message not sent.
+RS485ERR_GROUP_FULL = 17								;All RS485_GROUPS group entries in use.
 RS485ERR_STATE_MACHINE_RESET = 255						;Out of sync, state is reset.
 
+
+/*==================================================================================================*
+ *                                            M A C R O S
+ *==================================================================================================*/
+
+; CRC-16-CCITT (0x1021) update of the running CRC16 in crch:crcl with the byte in data; t1 and t2
+;	are scratch registers (R16-R31), data is not changed. Used by rs485_crc_update and by the
+;	rs485boot bootloader, so both calculate the same CRC16. (22 CPU cycles)
+.macro	RS485_CRC_UPDATE crcl:req, crch:req, data:req, t1:req, t2:req
+		mov		\t1,\data								;Get byte to add to calculation.
+		SWAPR	\crcl,\crch								;Start by swapping the CRC16 bytes.
+		eor		\crcl,\t1								;First XOR.
+		mov		\t2,\crcl								;Second XOR.
+		swap	\t2										;These 2 instructions are faster than 4x"lsr 4".
+		andi	\t2,0x0F
+		eor		\crcl,\t2
+		mov		\t2,\crcl								;Third XOR.
+		swap	\t2
+		andi	\t2,0xF0
+		eor		\crch,\t2
+		mov		\t2,\crcl								;Fourth XOR.
+		swap	\t2
+		mov		\t1,\t2
+		andi	\t2,0xF0
+		andi	\t1,0x0F
+		lsl		\t2
+		rol		\t1
+		eor		\crcl,\t2
+		eor		\crch,\t1
+.endm
+
 #endif
\ No newline at end of file